@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* latency statistics shared by benchmarks: percentiles of collected samples,
+* text table on stdout and JSON for regression tracking
+*/
+
+#ifndef BENCH_STAT_H
+#define BENCH_STAT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/**********************************/
+/* Types */
+
+typedef struct __benchStat_t {
+	char name[64];
+	unsigned int batch;
+	size_t samples;
+	double mean;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t max;
+} benchStat_t;
+
+/**********************************/
+/* Functions definitions */
+
+static int benchCmpU64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t*) a;
+	uint64_t y = *(const uint64_t*) b;
+	return x < y ? -1 : x > y;
+}
+
+static void benchPrintHeader(void) {
+	printf("%-36s %10s %8s %8s %8s %8s %10s\n", "benchmark [ns/op]", "mean", "p50", "p90", "p99", "p99.9", "max");
+}
+
+/*
+* sorts samples in place, each of them is the time of batch operations
+*/
+static void benchStatCompute(benchStat_t *st, const char *name, unsigned int batch, uint64_t *samples, size_t n) {
+	double sum = 0;
+	size_t i;
+	qsort(samples, n, sizeof(uint64_t), benchCmpU64);
+	for (i = 0; i < n; ++i) {
+		sum += samples[i];
+	}
+	snprintf(st->name, sizeof(st->name), "%s", name);
+	st->batch = batch;
+	st->samples = n;
+	st->mean = n ? sum / n / batch : 0;
+	st->p50 = n ? samples[n * 50 / 100] / batch : 0;
+	st->p90 = n ? samples[n * 90 / 100] / batch : 0;
+	st->p99 = n ? samples[n * 99 / 100] / batch : 0;
+	st->p999 = n ? samples[n * 999 / 1000] / batch : 0;
+	st->max = n ? samples[n - 1] / batch : 0;
+	printf("%-36s %10.1f %8llu %8llu %8llu %8llu %10llu\n", st->name, st->mean,
+		(unsigned long long) st->p50, (unsigned long long) st->p90,
+		(unsigned long long) st->p99, (unsigned long long) st->p999,
+		(unsigned long long) st->max);
+}
+
+static int benchWriteJson(const char *path, const char *suite, const benchStat_t *stats, int num) {
+	FILE *out = fopen(path, "w");
+	int i;
+	if (!out) {
+		return -1;
+	}
+	fprintf(out, "{\n  \"suite\": \"%s\",\n  \"benchmarks\": [\n", suite);
+	for (i = 0; i < num; ++i) {
+		const benchStat_t *st = &(stats[i]);
+		fprintf(out, "    {\"name\": \"%s\", \"batch\": %u, \"samples\": %zu, \"mean_ns\": %.1f, "
+			"\"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}%s\n",
+			st->name, st->batch, st->samples, st->mean,
+			(unsigned long long) st->p50, (unsigned long long) st->p90,
+			(unsigned long long) st->p99, (unsigned long long) st->p999,
+			(unsigned long long) st->max, i + 1 < num ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+	return fclose(out);
+}
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* preemption latency benchmark: CPU-bound tasks spin while the scheduler
+* tick switches them, for every quantum and task count it reports
+* - tick to switch: from the tick scheduled by the interval timer until the
+*   next task runs (timer slack, signal delivery, sigHand and swapcontext)
+* - ready to run: from the task becoming READY until it runs again, ideally
+*   (tasks - 1) quanta for round robin
+*
+* usage: latencyBench [-d durationMs] [-j results.json]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "taskLib.h"
+
+#include "benchStat.h"
+
+/**********************************/
+/* Global variables */
+
+#define BENCH_STATS_MAX 64
+#define BENCH_TASKS_MAX 16
+
+static const unsigned long quanta[] = {500, 1000, 5000, 10000};
+static const int taskCounts[] = {2, 4, 8, 16};
+
+static benchStat_t benchStats[BENCH_STATS_MAX];
+static int benchStatsNum;
+
+static uint64_t *tickSamples;
+static uint64_t *readySamples;
+static volatile size_t nSamples;
+static size_t maxSamples;
+
+static volatile int started;
+static volatile int lastRunner;
+static uint64_t timerStart;
+static uint64_t quantumNs;
+static uint64_t warmupEnd;
+static uint64_t benchEnd;
+
+/**********************************/
+/* Functions definitions */
+
+/*
+* runner change seen in the loop means the task was just switched in by a tick,
+* timer period does not drift so ticks are at timerStart + k * quantum
+*/
+static void spinProbe(int self) {
+	while (!started) {
+		schedule();
+	}
+	while (1) {
+		uint64_t now = taskTimeNs();
+		if (now >= benchEnd) {
+			break;
+		}
+		if (lastRunner != self) {
+			//time read above may be from before the task was switched out
+			now = taskTimeNs();
+			if (now >= warmupEnd && nSamples < maxSamples) {
+				tickSamples[nSamples] = (now - timerStart) % quantumNs;
+				readySamples[nSamples] = now - taskSelf()->readySince;
+				++nSamples;
+			}
+			lastRunner = self;
+		}
+	}
+}
+
+static void benchRun(unsigned long quantumUs, int tasks, uint64_t durationNs) {
+	taskNode_t *spinners[BENCH_TASKS_MAX];
+	char name[64];
+	int i;
+
+	started = 0;
+	lastRunner = -1;
+	nSamples = 0;
+	for (i = 1; i < tasks; ++i) {
+		spinners[i] = createTask();
+		initTask(spinners[i], (void (*)(void)) spinProbe, 1, i);
+	}
+
+	quantumNs = quantumUs * 1000ULL;
+	timerStart = taskTimeNs();
+	warmupEnd = timerStart + 2 * tasks * quantumNs;
+	benchEnd = warmupEnd + durationNs;
+	started = 1;
+	taskSetQuantum(quantumUs);
+	spinProbe(0);
+	taskSetQuantum(0);
+
+	for (i = 1; i < tasks; ++i) {
+		taskJoin(spinners[i]);
+		freeTask(spinners[i]);
+	}
+
+	snprintf(name, sizeof(name), "tick_to_switch/q%luus/t%d", quantumUs, tasks);
+	benchStatCompute(&(benchStats[benchStatsNum++]), name, 1, tickSamples, nSamples);
+	snprintf(name, sizeof(name), "ready_to_run/q%luus/t%d", quantumUs, tasks);
+	benchStatCompute(&(benchStats[benchStatsNum++]), name, 1, readySamples, nSamples);
+}
+
+int main(int argc, char **argv) {
+	const char *jsonPath = NULL;
+	uint64_t durationNs = 1000000000ULL;
+	unsigned int q, t;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:j:")) != -1) {
+		if (opt == 'd') {
+			durationNs = strtoull(optarg, NULL, 0) * 1000000ULL;
+		}
+		else if (opt == 'j') {
+			jsonPath = optarg;
+		}
+		else {
+			fprintf(stderr, "usage: %s [-d durationMs] [-j results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	//at most one switch per tick
+	maxSamples = durationNs / (quanta[0] * 1000ULL) + 1;
+	tickSamples = (uint64_t*) malloc(maxSamples * sizeof(uint64_t));
+	readySamples = (uint64_t*) malloc(maxSamples * sizeof(uint64_t));
+	if (!tickSamples || !readySamples) {
+		return 1;
+	}
+
+	taskLibInit();
+	taskSetQuantum(0);
+
+	benchPrintHeader();
+	for (q = 0; q < sizeof(quanta) / sizeof(quanta[0]); ++q) {
+		for (t = 0; t < sizeof(taskCounts) / sizeof(taskCounts[0]); ++t) {
+			benchRun(quanta[q], taskCounts[t], durationNs);
+		}
+	}
+
+	if (jsonPath && benchWriteJson(jsonPath, "latency", benchStats, benchStatsNum) != 0) {
+		perror(jsonPath);
+		return 1;
+	}
+	return 0;
+}
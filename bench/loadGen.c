@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* workload generator: populations of tasks (classes) loop doing a CPU burst,
+* partly under a mutex shared with other tasks, optionally split between
+* forked children, and then sleep; after the run it reports per class
+* throughput and response time (from the end of the sleep until the burst
+* is done) and the switch overhead of the whole run
+*
+* class is given as a comma separated list of keys, missing ones are zero:
+*   name=web,tasks=16,prio=0,burst=exp:200,sleep=exp:5000,locked=50,fanout=4
+* - burst, sleep: distribution (const, exp, uni) and mean in microseconds
+* - locked: percentage of every burst done holding a random shared mutex
+* - fanout: the burst is split between that many child tasks, joined after
+*
+* usage: loadGen [-c class]... [-d durationMs] [-q quantumUs] [-m mutexes]
+*                [-p prio_rr|rr|fifo] [-s] [-j results.json]
+* -s runs in virtual time, then the switch overhead is not measured
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "taskLib.h"
+
+#include "benchStat.h"
+
+/**********************************/
+/* Types */
+
+typedef enum __distType_t {
+	DIST_CONST = 0,
+	DIST_EXP,
+	DIST_UNI
+} distType_t;
+
+typedef struct __dist_t {
+	distType_t type;
+	double meanNs;
+} dist_t;
+
+typedef struct __loadClass_t {
+	char name[32];
+	int tasks;
+	int priority;
+	dist_t burst;
+	dist_t sleep;
+	int locked;
+	int fanout;
+	//results
+	unsigned long long completed;
+	uint64_t workNs;
+	uint64_t *samples;
+	size_t samplesNum;
+} loadClass_t;
+
+typedef struct __loadWorker_t {
+	loadClass_t *cls;
+	unsigned int seed;
+	taskNode_t *task;
+} loadWorker_t;
+
+/**********************************/
+/* Global variables */
+
+#define CLASSES_MAX 16
+#define MUTEXES_MAX 64
+#define FANOUT_MAX 64
+#define BENCH_STATS_MAX CLASSES_MAX
+//per class, later responses are not recorded
+#define SAMPLES_MAX (1 << 20)
+
+static const char *distNames[] = {"const", "exp", "uni"};
+static const char *policyNames[] = {"prio_rr", "rr", "fifo"};
+
+static const char *defaultClasses[] = {
+	"name=cpu,tasks=4,burst=exp:5000",
+	"name=io,tasks=8,prio=1,burst=exp:100,sleep=exp:2000",
+	"name=locked,tasks=8,burst=const:200,sleep=exp:1000,locked=50",
+	"name=fanout,tasks=2,burst=const:2000,sleep=exp:10000,fanout=4"
+};
+
+static benchStat_t benchStats[BENCH_STATS_MAX];
+
+static loadClass_t classes[CLASSES_MAX];
+static int classesNum;
+
+static myMutex_t mutexes[MUTEXES_MAX];
+static int mutexesNum = 4;
+
+static uint64_t loadEnd;
+
+static int simulate;
+//busy loop speed, bursts are fixed work, not wall time which includes preemption
+static double spinPerNs;
+static volatile unsigned long spinSink;
+
+/**********************************/
+/* Functions definitions */
+
+static uint64_t distDraw(const dist_t *dist, unsigned int *seed) {
+	double u = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+	if (dist->type == DIST_EXP) {
+		return (uint64_t) (-dist->meanNs * log(u));
+	}
+	if (dist->type == DIST_UNI) {
+		return (uint64_t) (2.0 * dist->meanNs * u);
+	}
+	return (uint64_t) dist->meanNs;
+}
+
+static int distParse(dist_t *dist, const char *spec) {
+	const char *colon = strchr(spec, ':');
+	int i;
+	if (!colon) {
+		return -1;
+	}
+	for (i = DIST_CONST; i <= DIST_UNI; ++i) {
+		if (!strncmp(spec, distNames[i], colon - spec) && strlen(distNames[i]) == (size_t) (colon - spec)) {
+			dist->type = (distType_t) i;
+			dist->meanNs = strtod(colon + 1, NULL) * 1000.0;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static int classParse(const char *spec) {
+	char buf[256];
+	char *key, *save;
+	loadClass_t *cls;
+	if (classesNum == CLASSES_MAX) {
+		return -1;
+	}
+	cls = &(classes[classesNum]);
+	memset(cls, 0, sizeof(loadClass_t));
+	snprintf(cls->name, sizeof(cls->name), "class%d", classesNum);
+	snprintf(buf, sizeof(buf), "%s", spec);
+	for (key = strtok_r(buf, ",", &save); key; key = strtok_r(NULL, ",", &save)) {
+		char *val = strchr(key, '=');
+		if (!val) {
+			return -1;
+		}
+		*val++ = '\0';
+		if (!strcmp(key, "name")) {
+			snprintf(cls->name, sizeof(cls->name), "%s", val);
+		}
+		else if (!strcmp(key, "tasks")) {
+			cls->tasks = atoi(val);
+		}
+		else if (!strcmp(key, "prio")) {
+			cls->priority = atoi(val);
+		}
+		else if (!strcmp(key, "burst")) {
+			if (distParse(&(cls->burst), val) != 0) {
+				return -1;
+			}
+		}
+		else if (!strcmp(key, "sleep")) {
+			if (distParse(&(cls->sleep), val) != 0) {
+				return -1;
+			}
+		}
+		else if (!strcmp(key, "locked")) {
+			cls->locked = atoi(val);
+		}
+		else if (!strcmp(key, "fanout")) {
+			cls->fanout = atoi(val);
+		}
+		else {
+			return -1;
+		}
+	}
+	if (cls->tasks <= 0 || cls->locked < 0 || cls->locked > 100 || cls->fanout < 0 || cls->fanout > FANOUT_MAX) {
+		return -1;
+	}
+	cls->samples = (uint64_t*) malloc(SAMPLES_MAX * sizeof(uint64_t));
+	if (!cls->samples) {
+		return -1;
+	}
+	++classesNum;
+	return 0;
+}
+
+static void spin(unsigned long iters) {
+	unsigned long i;
+	for (i = 0; i < iters; ++i) {
+		++spinSink;
+	}
+}
+
+//done with ticks off, before the load starts
+static void spinCalibrate(void) {
+	unsigned long iters = 1000000;
+	uint64_t t0, t1;
+	do {
+		iters *= 2;
+		t0 = taskTimeNs();
+		spin(iters);
+		t1 = taskTimeNs();
+	} while (t1 - t0 < 50000000ULL);
+	spinPerNs = (double) iters / (t1 - t0);
+}
+
+static void work(uint64_t ns) {
+	if (simulate) {
+		taskSimWork(ns);
+	}
+	else {
+		spin((unsigned long) (ns * spinPerNs));
+	}
+}
+
+static void doBurst(loadClass_t *cls, uint64_t ns, unsigned int *seed) {
+	uint64_t lockedNs = ns * cls->locked / 100;
+	if (lockedNs) {
+		myMutex_t *mutex = &(mutexes[rand_r(seed) % mutexesNum]);
+		lockMutex(mutex);
+		work(lockedNs);
+		unlockMutex(mutex);
+	}
+	work(ns - lockedNs);
+	blockSched();
+	cls->workNs += ns;
+	unblockSched();
+}
+
+static void childFunc(loadWorker_t *child) {
+	doBurst(child->cls, distDraw(&(child->cls->burst), &(child->seed)) / child->cls->fanout, &(child->seed));
+}
+
+static void workerFunc(loadWorker_t *worker) {
+	loadClass_t *cls = worker->cls;
+	loadWorker_t children[FANOUT_MAX];
+	int i;
+	while (1) {
+		uint64_t woken = taskTimeNs();
+		uint64_t sleepNs = distDraw(&(cls->sleep), &(worker->seed));
+		if (sleepNs) {
+			woken += sleepNs;
+			taskSleepUntil(woken);
+		}
+		if (woken >= loadEnd) {
+			break;
+		}
+		if (cls->fanout) {
+			for (i = 0; i < cls->fanout; ++i) {
+				children[i].cls = cls;
+				children[i].seed = rand_r(&(worker->seed));
+				children[i].task = createTask();
+				taskSetPriority(children[i].task, cls->priority);
+				initTask(children[i].task, (void (*)(void)) childFunc, 1, &(children[i]));
+			}
+			for (i = 0; i < cls->fanout; ++i) {
+				taskJoin(children[i].task);
+				freeTask(children[i].task);
+			}
+		}
+		else {
+			doBurst(cls, distDraw(&(cls->burst), &(worker->seed)), &(worker->seed));
+		}
+		//workers of one class share the counters
+		blockSched();
+		++cls->completed;
+		if (cls->samplesNum < SAMPLES_MAX) {
+			cls->samples[cls->samplesNum++] = taskTimeNs() - woken;
+		}
+		unblockSched();
+	}
+}
+
+static uint64_t cpuTimeNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-c class]... [-d durationMs] [-q quantumUs] [-m mutexes]\n"
+		"       [-p prio_rr|rr|fifo] [-s] [-j results.json]\n"
+		"class: name=web,tasks=16,prio=0,burst=exp:200,sleep=exp:5000,locked=50,fanout=4\n", prog);
+}
+
+int main(int argc, char **argv) {
+	const char *jsonPath = NULL;
+	uint64_t durationNs = 5000000000ULL;
+	unsigned long quantum = 10000;
+	schedPolicy_t policy = POLICY_PRIO_RR;
+	loadWorker_t *workers;
+	taskMetrics_t m0, m1;
+	uint64_t start, cpu0, switches;
+	int workersNum = 0;
+	int opt, i, j;
+
+	while ((opt = getopt(argc, argv, "c:d:q:m:p:sj:")) != -1) {
+		if (opt == 'c') {
+			if (classParse(optarg) != 0) {
+				fprintf(stderr, "bad class %s\n", optarg);
+				return 1;
+			}
+		}
+		else if (opt == 'd') {
+			durationNs = strtoull(optarg, NULL, 0) * 1000000ULL;
+		}
+		else if (opt == 'q') {
+			quantum = strtoul(optarg, NULL, 0);
+		}
+		else if (opt == 'm') {
+			mutexesNum = atoi(optarg);
+		}
+		else if (opt == 'p') {
+			for (policy = POLICY_PRIO_RR; policy <= POLICY_FIFO; ++policy) {
+				if (!strcmp(optarg, policyNames[policy])) {
+					break;
+				}
+			}
+		}
+		else if (opt == 's') {
+			simulate = 1;
+		}
+		else if (opt == 'j') {
+			jsonPath = optarg;
+		}
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (mutexesNum <= 0 || mutexesNum > MUTEXES_MAX || policy > POLICY_FIFO) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (!classesNum) {
+		for (i = 0; i < (int) (sizeof(defaultClasses) / sizeof(defaultClasses[0])); ++i) {
+			classParse(defaultClasses[i]);
+		}
+	}
+	for (i = 0; i < classesNum; ++i) {
+		workersNum += classes[i].tasks;
+	}
+	workers = (loadWorker_t*) malloc(workersNum * sizeof(loadWorker_t));
+	if (!workers) {
+		return 1;
+	}
+	for (i = 0; i < mutexesNum; ++i) {
+		initMyMutex(&(mutexes[i]));
+	}
+
+	taskLibInit();
+	if (simulate) {
+		taskSimEnable();
+	}
+	else {
+		taskSetQuantum(0);
+		spinCalibrate();
+	}
+	taskSetPolicy(policy);
+	taskSetQuantum(quantum);
+	//spawning and joining must not wait for the workers
+	taskSetPriority(taskSelf(), 1000);
+
+	taskGetMetrics(&m0);
+	cpu0 = cpuTimeNs();
+	start = taskTimeNs();
+	loadEnd = start + durationNs;
+	for (i = 0, j = 0; i < classesNum; ++i) {
+		int k;
+		for (k = 0; k < classes[i].tasks; ++k, ++j) {
+			workers[j].cls = &(classes[i]);
+			workers[j].seed = j + 1;
+			workers[j].task = createTask();
+			taskSetPriority(workers[j].task, classes[i].priority);
+			initTask(workers[j].task, (void (*)(void)) workerFunc, 1, &(workers[j]));
+		}
+	}
+	for (j = 0; j < workersNum; ++j) {
+		taskJoin(workers[j].task);
+		freeTask(workers[j].task);
+	}
+	durationNs = taskTimeNs() - start;
+	taskGetMetrics(&m1);
+	switches = (m1.voluntarySwitches - m0.voluntarySwitches) + (m1.preemptions - m0.preemptions);
+
+	printf("%-16s %6s %12s\n", "class", "tasks", "ops/s");
+	for (i = 0; i < classesNum; ++i) {
+		printf("%-16s %6d %12.1f\n", classes[i].name, classes[i].tasks, classes[i].completed / (durationNs / 1e9));
+	}
+	printf("\n");
+	benchPrintHeader();
+	for (i = 0; i < classesNum; ++i) {
+		char name[64];
+		snprintf(name, sizeof(name), "response/%s", classes[i].name);
+		benchStatCompute(&(benchStats[i]), name, 1, classes[i].samples, classes[i].samplesNum);
+	}
+	printf("\nswitches %llu (%.1f/s), preemptions %llu",
+		(unsigned long long) switches, switches / (durationNs / 1e9),
+		(unsigned long long) (m1.preemptions - m0.preemptions));
+	if (!simulate) {
+		uint64_t workNs = 0;
+		uint64_t cpuNs = cpuTimeNs() - cpu0;
+		for (i = 0; i < classesNum; ++i) {
+			workNs += classes[i].workNs;
+		}
+		printf(", cpu %.3f s, overhead per switch %.1f ns",
+			cpuNs / 1e9, switches && cpuNs > workNs ? (double) (cpuNs - workNs) / switches : 0.0);
+	}
+	printf("\n");
+
+	if (jsonPath && benchWriteJson(jsonPath, "load", benchStats, classesNum) != 0) {
+		perror(jsonPath);
+		return 1;
+	}
+	return 0;
+}
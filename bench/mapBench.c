@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* hash map benchmark: tasks do a mix of lookups and updates over a fixed key
+* space, for several read shares and task counts, on the sharded taskMap_t
+* with lock-free reads and on a single-shard map behind one global mutex;
+* samples are batches of operations, ticks stay on so lock holders get
+* preempted as in real use
+*
+* usage: mapBench [-n opsPerTask] [-k keys] [-q quantumUs] [-j results.json]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "taskLib.h"
+#include "taskMap.h"
+
+#include "benchStat.h"
+
+/**********************************/
+/* Global variables */
+
+#define BENCH_STATS_MAX 32
+#define BENCH_TASKS_MAX 16
+#define BENCH_BATCH 64
+
+static const int readShares[] = {100, 90, 50};
+static const int taskCounts[] = {1, 4, 16};
+
+static benchStat_t benchStats[BENCH_STATS_MAX];
+static int benchStatsNum;
+
+static uint64_t *samples;
+static size_t nSamples;
+static size_t maxSamples;
+
+static taskMap_t benchMap;
+static myMutex_t globalMutex;
+static int useGlobal;
+static int readShare;
+static size_t opsPerTask;
+static uint64_t keySpace;
+
+/**********************************/
+/* Functions definitions */
+
+static void mapOps(int id) {
+	unsigned int seed = id + 1;
+	size_t i;
+	int j;
+	for (i = 0; i < opsPerTask / BENCH_BATCH; ++i) {
+		uint64_t t0 = taskTimeNs();
+		for (j = 0; j < BENCH_BATCH; ++j) {
+			uint64_t key = (uint64_t) rand_r(&seed) % keySpace;
+			int read = rand_r(&seed) % 100 < readShare;
+			if (useGlobal) {
+				lockMutex(&globalMutex);
+			}
+			if (read) {
+				taskMapGet(&benchMap, key);
+			}
+			else {
+				taskMapPut(&benchMap, key, (void*) (uintptr_t) (key + 1));
+			}
+			if (useGlobal) {
+				unlockMutex(&globalMutex);
+			}
+		}
+		//tasks share the sample buffer
+		blockSched();
+		if (nSamples < maxSamples) {
+			samples[nSamples++] = taskTimeNs() - t0;
+		}
+		unblockSched();
+	}
+}
+
+static void benchRun(int global, int share, int tasks) {
+	taskNode_t *workers[BENCH_TASKS_MAX];
+	char name[64];
+	uint64_t key;
+	int i;
+
+	if (taskMapInit(&benchMap, global ? 1 : 0, keySpace) != 0) {
+		exit(1);
+	}
+	for (key = 0; key < keySpace; ++key) {
+		taskMapPut(&benchMap, key, (void*) (uintptr_t) (key + 1));
+	}
+	useGlobal = global;
+	readShare = share;
+	nSamples = 0;
+	for (i = 0; i < tasks; ++i) {
+		workers[i] = createTask();
+		initTask(workers[i], (void (*)(void)) mapOps, 1, i);
+	}
+	for (i = 0; i < tasks; ++i) {
+		taskJoin(workers[i]);
+		freeTask(workers[i]);
+	}
+	//let pending RCU callbacks run before the map goes away
+	synchronizeRcu();
+	schedule();
+	taskMapDestroy(&benchMap);
+
+	snprintf(name, sizeof(name), "map_%s/r%d/t%d", global ? "global_mutex" : "sharded_rcu", share, tasks);
+	benchStatCompute(&(benchStats[benchStatsNum++]), name, BENCH_BATCH, samples, nSamples);
+}
+
+int main(int argc, char **argv) {
+	const char *jsonPath = NULL;
+	unsigned long quantum = 1000;
+	unsigned int r, t;
+	int global, opt;
+
+	opsPerTask = 100000;
+	keySpace = 65536;
+	while ((opt = getopt(argc, argv, "n:k:q:j:")) != -1) {
+		if (opt == 'n') {
+			opsPerTask = strtoul(optarg, NULL, 0);
+		}
+		else if (opt == 'k') {
+			keySpace = strtoull(optarg, NULL, 0);
+		}
+		else if (opt == 'q') {
+			quantum = strtoul(optarg, NULL, 0);
+		}
+		else if (opt == 'j') {
+			jsonPath = optarg;
+		}
+		else {
+			fprintf(stderr, "usage: %s [-n opsPerTask] [-k keys] [-q quantumUs] [-j results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	maxSamples = BENCH_TASKS_MAX * (opsPerTask / BENCH_BATCH) + 1;
+	samples = (uint64_t*) malloc(maxSamples * sizeof(uint64_t));
+	if (!samples || !keySpace || opsPerTask < BENCH_BATCH) {
+		return 1;
+	}
+
+	taskLibInit();
+	taskSetQuantum(quantum);
+	initMyMutex(&globalMutex);
+
+	benchPrintHeader();
+	for (global = 1; global >= 0; --global) {
+		for (r = 0; r < sizeof(readShares) / sizeof(readShares[0]); ++r) {
+			for (t = 0; t < sizeof(taskCounts) / sizeof(taskCounts[0]); ++t) {
+				benchRun(global, readShares[r], taskCounts[t]);
+			}
+		}
+	}
+
+	if (jsonPath && benchWriteJson(jsonPath, "map", benchStats, benchStatsNum) != 0) {
+		perror(jsonPath);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* cross-node placement benchmark: for every pair of CPU node and memory node
+* the scheduler is bound with taskNumaBind and tasks with fresh stacks take
+* turns, each touching a part of its stack before yielding; remote pairs
+* show the cost of running on stacks of another socket
+*
+* usage: numaBench [-n iterations] [-t tasks] [-j results.json]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+
+#include "taskLib.h"
+
+#include "benchStat.h"
+
+/**********************************/
+/* Global variables */
+
+#define BENCH_STATS_MAX 64
+#define BENCH_TASKS_MAX 64
+//part of the 16 KiB task stack written on every run
+#define TOUCH_BYTES 8192
+
+static benchStat_t benchStats[BENCH_STATS_MAX];
+static int benchStatsNum;
+
+static uint64_t *samples;
+static volatile size_t nSamples;
+static size_t total;
+static volatile uint64_t stamp;
+
+/**********************************/
+/* Functions definitions */
+
+static void benchRecord(uint64_t ns) {
+	if (nSamples < total) {
+		samples[nSamples++] = ns;
+	}
+}
+
+//switch time includes the stack traffic of the task switched in
+static void touchRing(void) {
+	volatile char buf[TOUCH_BYTES];
+	while (nSamples < total) {
+		stamp = taskTimeNs();
+		schedule();
+		memset((char*) buf, (int) nSamples, sizeof(buf));
+		benchRecord(taskTimeNs() - stamp);
+	}
+}
+
+static void emptyFunc(void) {
+}
+
+static void benchPair(int cpuNode, int memNode, int tasks) {
+	taskNode_t *ring[BENCH_TASKS_MAX];
+	char name[64];
+	size_t i;
+	int t;
+
+	if (taskNumaBind(cpuNode, memNode) != 0) {
+		fprintf(stderr, "cannot bind to cpu node %d, memory node %d\n", cpuNode, memNode);
+		return;
+	}
+	nSamples = 0;
+	for (t = 0; t < tasks; ++t) {
+		ring[t] = createTask();
+		initTask(ring[t], touchRing, 0);
+	}
+	for (t = 0; t < tasks; ++t) {
+		taskJoin(ring[t]);
+		freeTask(ring[t]);
+	}
+	snprintf(name, sizeof(name), "switch_touch/cpu%d/mem%d", cpuNode, memNode);
+	benchStatCompute(&(benchStats[benchStatsNum++]), name, 1, samples, nSamples);
+
+	nSamples = 0;
+	for (i = 0; i < total; ++i) {
+		uint64_t t0 = taskTimeNs();
+		taskNode_t *task = createTask();
+		initTask(task, emptyFunc, 0);
+		taskJoin(task);
+		freeTask(task);
+		benchRecord(taskTimeNs() - t0);
+	}
+	snprintf(name, sizeof(name), "spawn_join/cpu%d/mem%d", cpuNode, memNode);
+	benchStatCompute(&(benchStats[benchStatsNum++]), name, 1, samples, nSamples);
+}
+
+int main(int argc, char **argv) {
+	const char *jsonPath = NULL;
+	int tasks = 8;
+	int nodes, c, m, opt;
+
+	total = 100000;
+	while ((opt = getopt(argc, argv, "n:t:j:")) != -1) {
+		if (opt == 'n') {
+			total = strtoul(optarg, NULL, 0);
+		}
+		else if (opt == 't') {
+			tasks = atoi(optarg);
+		}
+		else if (opt == 'j') {
+			jsonPath = optarg;
+		}
+		else {
+			fprintf(stderr, "usage: %s [-n iterations] [-t tasks] [-j results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	samples = (uint64_t*) malloc(total * sizeof(uint64_t));
+	if (!samples || !total || tasks <= 0 || tasks > BENCH_TASKS_MAX) {
+		return 1;
+	}
+	//stacks come straight from mmap, so every pair gets pages on its memory node
+	mallopt(M_MMAP_THRESHOLD, 16384);
+
+	taskLibInit();
+	taskSetQuantum(0);
+
+	nodes = taskNumaNodes();
+	printf("NUMA nodes: %d\n", nodes);
+	benchPrintHeader();
+	for (c = 0; c < nodes; ++c) {
+		for (m = 0; m < nodes && benchStatsNum + 2 <= BENCH_STATS_MAX; ++m) {
+			benchPair(c, m, tasks);
+		}
+	}
+
+	if (jsonPath && benchWriteJson(jsonPath, "numa", benchStats, benchStatsNum) != 0) {
+		perror(jsonPath);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* context switch microbenchmarks: voluntary and preemptive switch, spawn+join,
+* mutex lock/unlock, flat combining lock, delegation to an owner task and
+* wakeup of a higher priority task, compared with pthreads and raw swapcontext
+*
+* usage: switchBench [-n iterations] [-j results.json]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "taskLib.h"
+
+#include <pthread.h>
+
+#include "benchStat.h"
+
+/**********************************/
+/* Global variables */
+
+#define BENCH_STATS_MAX 16
+//fast operations are timed in batches, clock read would dominate otherwise
+#define BENCH_BATCH 64
+
+static benchStat_t benchStats[BENCH_STATS_MAX];
+static int benchStatsNum;
+
+static uint64_t *samples;
+static volatile size_t nSamples;
+static size_t total;
+static volatile uint64_t stamp;
+
+static myMutex_t benchMutex;
+static myMutex_t gateMutex;
+static fcLock_t benchFcLock;
+static unsigned long fcCounter;
+static taskMailbox_t benchMailbox;
+static volatile int ownerStop;
+
+static ucontext_t rawCtx[2];
+
+static pthread_mutex_t pMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pCond = PTHREAD_COND_INITIALIZER;
+static volatile int pTurn;
+
+/**********************************/
+/* Functions definitions */
+
+static void benchReport(const char *name, unsigned int batch) {
+	benchStatCompute(&(benchStats[benchStatsNum++]), name, batch, samples, nSamples);
+	nSamples = 0;
+}
+
+static void benchRecord(uint64_t ns) {
+	if (nSamples < total) {
+		samples[nSamples++] = ns;
+	}
+}
+
+//both sides stamp before switching, the resumed one records the difference
+static void pingPong(void) {
+	while (nSamples < total) {
+		stamp = taskTimeNs();
+		schedule();
+		benchRecord(taskTimeNs() - stamp);
+	}
+}
+
+static void preemptPingPong(void) {
+	while (nSamples < total) {
+		stamp = taskTimeNs();
+		raise(SIGALRM);
+		benchRecord(taskTimeNs() - stamp);
+	}
+}
+
+static void emptyFunc(void) {
+}
+
+static void contendFunc(void) {
+	while (nSamples < total) {
+		lockMutex(&benchMutex);
+		if (stamp) {
+			benchRecord(taskTimeNs() - stamp);
+		}
+		//let the other task block on the mutex
+		schedule();
+		stamp = taskTimeNs();
+		unlockMutex(&benchMutex);
+		schedule();
+	}
+}
+
+//higher priority task is switched in right when the mutex is unlocked
+static void wakeFunc(void) {
+	while (nSamples < total) {
+		lockMutex(&benchMutex);
+		benchRecord(taskTimeNs() - stamp);
+		unlockMutex(&benchMutex);
+		//wait until main holds benchMutex again
+		lockMutex(&gateMutex);
+		unlockMutex(&gateMutex);
+	}
+}
+
+static void benchVoluntary(void) {
+	taskNode_t *task = createTask();
+	initTask(task, pingPong, 0);
+	pingPong();
+	taskJoin(task);
+	freeTask(task);
+	benchReport("task_switch_voluntary", 1);
+}
+
+static void benchPreempt(void) {
+	taskNode_t *task = createTask();
+	initTask(task, preemptPingPong, 0);
+	preemptPingPong();
+	taskJoin(task);
+	freeTask(task);
+	benchReport("task_switch_preempt", 1);
+}
+
+static void benchSpawnJoin(void) {
+	size_t i;
+	for (i = 0; i < total; ++i) {
+		uint64_t t0 = taskTimeNs();
+		taskNode_t *task = createTask();
+		initTask(task, emptyFunc, 0);
+		taskJoin(task);
+		freeTask(task);
+		benchRecord(taskTimeNs() - t0);
+	}
+	benchReport("task_spawn_join", 1);
+}
+
+static void benchMutexUncontended(void) {
+	size_t i;
+	int j;
+	initMyMutex(&benchMutex);
+	for (i = 0; i < total; ++i) {
+		uint64_t t0 = taskTimeNs();
+		for (j = 0; j < BENCH_BATCH; ++j) {
+			lockMutex(&benchMutex);
+			unlockMutex(&benchMutex);
+		}
+		benchRecord(taskTimeNs() - t0);
+	}
+	benchReport("task_mutex_uncontended", BENCH_BATCH);
+}
+
+static void fcIncrement(void *arg) {
+	(void) arg;
+	++fcCounter;
+}
+
+static void benchFcUncontended(void) {
+	size_t i;
+	int j;
+	fcLockInit(&benchFcLock);
+	for (i = 0; i < total; ++i) {
+		uint64_t t0 = taskTimeNs();
+		for (j = 0; j < BENCH_BATCH; ++j) {
+			fcExecute(&benchFcLock, fcIncrement, NULL);
+		}
+		benchRecord(taskTimeNs() - t0);
+	}
+	benchReport("task_fc_lock_uncontended", BENCH_BATCH);
+}
+
+static void *delegateIncrement(void *arg) {
+	++fcCounter;
+	return arg;
+}
+
+static void ownerFunc(void) {
+	while (!ownerStop) {
+		delegateServe(&benchMailbox);
+	}
+}
+
+//round trip to an owner task: two switches plus queueing
+static void benchDelegateCall(void) {
+	taskNode_t *owner = createTask();
+	size_t i;
+	mailboxInit(&benchMailbox, owner);
+	ownerStop = 0;
+	initTask(owner, ownerFunc, 0);
+	for (i = 0; i < total; ++i) {
+		uint64_t t0 = taskTimeNs();
+		delegateCall(&benchMailbox, delegateIncrement, NULL);
+		benchRecord(taskTimeNs() - t0);
+	}
+	ownerStop = 1;
+	delegateCall(&benchMailbox, delegateIncrement, NULL);
+	taskJoin(owner);
+	freeTask(owner);
+	benchReport("task_delegate_call", 1);
+}
+
+static void benchMutexContended(void) {
+	taskNode_t *task = createTask();
+	initMyMutex(&benchMutex);
+	stamp = 0;
+	initTask(task, contendFunc, 0);
+	contendFunc();
+	taskJoin(task);
+	freeTask(task);
+	benchReport("task_mutex_contended_handoff", 1);
+}
+
+static void benchWakePreempt(void) {
+	taskNode_t *task = createTask();
+	size_t seen;
+	initMyMutex(&benchMutex);
+	initMyMutex(&gateMutex);
+	lockMutex(&benchMutex);
+	lockMutex(&gateMutex);
+	taskSetPriority(task, 1);
+	initTask(task, wakeFunc, 0);
+	while (nSamples < total) {
+		seen = nSamples;
+		stamp = taskTimeNs();
+		unlockMutex(&benchMutex);
+		if (nSamples == seen) {
+			//no immediate preemption, let the woken task run
+			schedule();
+		}
+		lockMutex(&benchMutex);
+		unlockMutex(&gateMutex);
+		lockMutex(&gateMutex);
+	}
+	unlockMutex(&benchMutex);
+	unlockMutex(&gateMutex);
+	taskJoin(task);
+	freeTask(task);
+	benchReport("task_wake_preempt", 1);
+}
+
+static void rawPingPong(int self) {
+	while (nSamples < total) {
+		stamp = taskTimeNs();
+		swapcontext(&(rawCtx[self]), &(rawCtx[!self]));
+		benchRecord(taskTimeNs() - stamp);
+	}
+}
+
+static void rawPeer(void) {
+	rawPingPong(1);
+	//let the main side see the end of the run
+	setcontext(&(rawCtx[0]));
+}
+
+static void benchRawSwapcontext(void) {
+	static char stack[16384];
+	getcontext(&(rawCtx[1]));
+	rawCtx[1].uc_stack.ss_sp = stack;
+	rawCtx[1].uc_stack.ss_size = sizeof(stack);
+	rawCtx[1].uc_link = NULL;
+	makecontext(&(rawCtx[1]), rawPeer, 0);
+	rawPingPong(0);
+	benchReport("raw_swapcontext", 1);
+}
+
+static void *pthreadPingPong(void *arg) {
+	int self = (int) (intptr_t) arg;
+	pthread_mutex_lock(&pMutex);
+	while (nSamples < total) {
+		while (pTurn != self && nSamples < total) {
+			pthread_cond_wait(&pCond, &pMutex);
+		}
+		if (stamp) {
+			benchRecord(taskTimeNs() - stamp);
+		}
+		stamp = taskTimeNs();
+		pTurn = !self;
+		pthread_cond_signal(&pCond);
+	}
+	pthread_cond_broadcast(&pCond);
+	pthread_mutex_unlock(&pMutex);
+	return NULL;
+}
+
+static void *pthreadEmpty(void *arg) {
+	return arg;
+}
+
+static void benchPthreads(void) {
+	pthread_t thread;
+	sigset_t mask, oldMask;
+	size_t i;
+	int j;
+
+	//threads do not take part in task scheduling
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGALRM);
+	pthread_sigmask(SIG_BLOCK, &mask, &oldMask);
+
+	stamp = 0;
+	pTurn = 0;
+	pthread_create(&thread, NULL, pthreadPingPong, (void*) 1);
+	pthreadPingPong((void*) 0);
+	pthread_join(thread, NULL);
+	benchReport("pthread_condvar_switch", 1);
+
+	for (i = 0; i < total; ++i) {
+		uint64_t t0 = taskTimeNs();
+		pthread_create(&thread, NULL, pthreadEmpty, NULL);
+		pthread_join(thread, NULL);
+		benchRecord(taskTimeNs() - t0);
+	}
+	benchReport("pthread_create_join", 1);
+
+	for (i = 0; i < total; ++i) {
+		uint64_t t0 = taskTimeNs();
+		for (j = 0; j < BENCH_BATCH; ++j) {
+			pthread_mutex_lock(&pMutex);
+			pthread_mutex_unlock(&pMutex);
+		}
+		benchRecord(taskTimeNs() - t0);
+	}
+	benchReport("pthread_mutex_uncontended", BENCH_BATCH);
+
+	pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+}
+
+int main(int argc, char **argv) {
+	const char *jsonPath = NULL;
+	int opt;
+
+	total = 100000;
+	while ((opt = getopt(argc, argv, "n:j:")) != -1) {
+		if (opt == 'n') {
+			total = strtoul(optarg, NULL, 0);
+		}
+		else if (opt == 'j') {
+			jsonPath = optarg;
+		}
+		else {
+			fprintf(stderr, "usage: %s [-n iterations] [-j results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+	samples = (uint64_t*) malloc(total * sizeof(uint64_t));
+	if (!samples || !total) {
+		return 1;
+	}
+
+	taskLibInit();
+	//ticks would disturb the measured switches, preemption is raised by hand
+	taskSetQuantum(0);
+
+	benchPrintHeader();
+	benchVoluntary();
+	benchPreempt();
+	benchSpawnJoin();
+	benchMutexUncontended();
+	benchMutexContended();
+	benchFcUncontended();
+	benchDelegateCall();
+	benchWakePreempt();
+	benchRawSwapcontext();
+	benchPthreads();
+
+	if (jsonPath && benchWriteJson(jsonPath, "switch", benchStats, benchStatsNum) != 0) {
+		perror(jsonPath);
+		return 1;
+	}
+	return 0;
+}
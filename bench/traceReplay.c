@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* offline replay of a scheduler trace saved by taskTraceSave: every traced
+* task becomes a script of CPU bursts and sleeps, which is run in virtual
+* time once per scheduling policy; reported is the delay from the end of a
+* sleep until the task runs again and the response time until its next
+* burst is done
+*
+* the replay is open loop, mutex and join waits are replayed as fixed sleeps
+* of the recorded length and do not depend on the replayed order
+*
+* usage: traceReplay [-p prio_rr,rr,fifo] [-q quantum_us] [-j results.json] trace.txt
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "taskLib.h"
+
+#include "benchStat.h"
+
+/**********************************/
+/* Types */
+
+typedef struct __replaySeg_t {
+	uint64_t burst;
+	//zero for the last segment, task exits after its burst
+	uint64_t sleep;
+} replaySeg_t;
+
+typedef struct __replayTask_t {
+	unsigned int id;
+	int priority;
+	uint64_t start;
+	uint64_t lastTime;
+	uint64_t lastRun;
+	int blocked;
+	replaySeg_t *segs;
+	size_t segsNum;
+	size_t segsCap;
+	taskNode_t *task;
+} replayTask_t;
+
+/**********************************/
+/* Global variables */
+
+#define BENCH_STATS_MAX 8
+#define LINE_MAX_LEN 256
+
+static const char *policyNames[] = {"prio_rr", "rr", "fifo"};
+
+static benchStat_t benchStats[BENCH_STATS_MAX];
+static int benchStatsNum;
+
+static replayTask_t *tasks;
+static size_t tasksNum;
+static size_t tasksCap;
+static uint64_t traceStart;
+
+static uint64_t *wakeSamples;
+static size_t wakeNum;
+static uint64_t *respSamples;
+static size_t respNum;
+static size_t samplesCap;
+
+/**********************************/
+/* Functions definitions */
+
+static replayTask_t *findTask(unsigned int id, uint64_t time, uint64_t runNs, int priority) {
+	size_t i;
+	for (i = 0; i < tasksNum; ++i) {
+		if (tasks[i].id == id) {
+			return &(tasks[i]);
+		}
+	}
+	if (tasksNum == tasksCap) {
+		tasksCap = tasksCap ? tasksCap * 2 : 64;
+		tasks = (replayTask_t*) realloc(tasks, tasksCap * sizeof(replayTask_t));
+		if (!tasks) {
+			exit(1);
+		}
+	}
+	//tasks running before the trace started begin at their first event
+	memset(&(tasks[tasksNum]), 0, sizeof(replayTask_t));
+	tasks[tasksNum].id = id;
+	tasks[tasksNum].priority = priority;
+	tasks[tasksNum].start = time;
+	tasks[tasksNum].lastRun = runNs;
+	return &(tasks[tasksNum++]);
+}
+
+static void addSeg(replayTask_t *rt, uint64_t burst, uint64_t sleep) {
+	if (rt->segsNum == rt->segsCap) {
+		rt->segsCap = rt->segsCap ? rt->segsCap * 2 : 8;
+		rt->segs = (replaySeg_t*) realloc(rt->segs, rt->segsCap * sizeof(replaySeg_t));
+		if (!rt->segs) {
+			exit(1);
+		}
+	}
+	rt->segs[rt->segsNum].burst = burst;
+	rt->segs[rt->segsNum].sleep = sleep;
+	++rt->segsNum;
+}
+
+/*
+* burst is the CPU time between wake and block, sleep the time between
+* block and wake; a task still sleeping at the end of the trace is dropped
+* after its last burst
+*/
+static int loadTrace(const char *path) {
+	char line[LINE_MAX_LEN];
+	FILE *in = fopen(path, "r");
+	size_t i;
+	if (!in) {
+		return -1;
+	}
+	traceStart = 0;
+	while (fgets(line, sizeof(line), in)) {
+		unsigned long long time, runNs;
+		unsigned int id, arg;
+		int priority;
+		char event[16];
+		replayTask_t *rt;
+		if (line[0] == '#' ||
+				sscanf(line, "%llu %15s %u %llu %d %u", &time, event, &id, &runNs, &priority, &arg) != 6) {
+			continue;
+		}
+		if (!traceStart) {
+			traceStart = time;
+		}
+		rt = findTask(id, time, runNs, priority);
+		if (!strcmp(event, "block")) {
+			rt->blocked = 1;
+			rt->lastTime = time;
+			addSeg(rt, runNs - rt->lastRun, 0);
+			rt->lastRun = runNs;
+		}
+		else if (!strcmp(event, "wake") && rt->blocked && rt->segsNum) {
+			rt->blocked = 0;
+			rt->segs[rt->segsNum - 1].sleep = time - rt->lastTime;
+		}
+		else if (!strcmp(event, "exit")) {
+			addSeg(rt, runNs - rt->lastRun, 0);
+			rt->lastRun = runNs;
+		}
+	}
+	fclose(in);
+	for (i = 0; i < tasksNum; ++i) {
+		samplesCap += tasks[i].segsNum;
+	}
+	wakeSamples = (uint64_t*) malloc((samplesCap + 1) * sizeof(uint64_t));
+	respSamples = (uint64_t*) malloc((samplesCap + 1) * sizeof(uint64_t));
+	return wakeSamples && respSamples ? 0 : -1;
+}
+
+static void replayFunc(replayTask_t *rt) {
+	size_t i;
+	uint64_t woken = 0;
+	for (i = 0; i < rt->segsNum; ++i) {
+		taskSimWork(rt->segs[i].burst);
+		if (woken) {
+			respSamples[respNum++] = taskTimeNs() - woken;
+		}
+		if (!rt->segs[i].sleep) {
+			break;
+		}
+		woken = taskTimeNs() + rt->segs[i].sleep;
+		taskSleepUntil(woken);
+		wakeSamples[wakeNum++] = taskTimeNs() - woken;
+	}
+}
+
+static int cmpStart(const void *a, const void *b) {
+	const replayTask_t *x = (const replayTask_t*) a;
+	const replayTask_t *y = (const replayTask_t*) b;
+	return x->start < y->start ? -1 : x->start > y->start;
+}
+
+static void replayPolicy(schedPolicy_t policy) {
+	char name[64];
+	uint64_t base = taskTimeNs();
+	size_t i;
+
+	taskSetPolicy(policy);
+	wakeNum = 0;
+	respNum = 0;
+	for (i = 0; i < tasksNum; ++i) {
+		replayTask_t *rt = &(tasks[i]);
+		taskSleepUntil(base + rt->start - traceStart);
+		rt->task = createTask();
+		taskSetPriority(rt->task, rt->priority);
+		initTask(rt->task, (void (*)(void)) replayFunc, 1, rt);
+	}
+	for (i = 0; i < tasksNum; ++i) {
+		taskJoin(tasks[i].task);
+		freeTask(tasks[i].task);
+	}
+	snprintf(name, sizeof(name), "replay_%s_wake_to_run", policyNames[policy]);
+	benchStatCompute(&(benchStats[benchStatsNum++]), name, 1, wakeSamples, wakeNum);
+	snprintf(name, sizeof(name), "replay_%s_response", policyNames[policy]);
+	benchStatCompute(&(benchStats[benchStatsNum++]), name, 1, respSamples, respNum);
+}
+
+int main(int argc, char **argv) {
+	const char *jsonPath = NULL;
+	char defaultPolicies[] = "prio_rr,rr,fifo";
+	char *policies = defaultPolicies;
+	char *policy;
+	unsigned long quantum = TASK_QUANTUM_DEFAULT_US;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:q:j:")) != -1) {
+		if (opt == 'p') {
+			policies = optarg;
+		}
+		else if (opt == 'q') {
+			quantum = strtoul(optarg, NULL, 0);
+		}
+		else if (opt == 'j') {
+			jsonPath = optarg;
+		}
+		else {
+			optind = argc;
+			break;
+		}
+	}
+	if (optind + 1 != argc) {
+		fprintf(stderr, "usage: %s [-p prio_rr,rr,fifo] [-q quantum_us] [-j results.json] trace.txt\n", argv[0]);
+		return 1;
+	}
+	if (loadTrace(argv[optind]) != 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+	qsort(tasks, tasksNum, sizeof(replayTask_t), cmpStart);
+
+	taskLibInit();
+	taskSimEnable();
+	taskSetQuantum(quantum);
+	//spawning has to happen on time whatever the replayed priorities are
+	taskSetPriority(taskSelf(), 1000);
+
+	benchPrintHeader();
+	for (policy = strtok(policies, ","); policy; policy = strtok(NULL, ",")) {
+		schedPolicy_t p;
+		for (p = POLICY_PRIO_RR; p <= POLICY_FIFO; ++p) {
+			if (!strcmp(policy, policyNames[p])) {
+				break;
+			}
+		}
+		if (p > POLICY_FIFO || benchStatsNum + 2 > BENCH_STATS_MAX) {
+			fprintf(stderr, "unknown policy %s\n", policy);
+			return 1;
+		}
+		replayPolicy(p);
+	}
+
+	if (jsonPath && benchWriteJson(jsonPath, "trace_replay", benchStats, benchStatsNum) != 0) {
+		perror(jsonPath);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+
+#include "taskLib.h"
+
+/**********************************/
+/* User functions */
+
+static void func1(void) {
+	int i = 0;
+	while (i < 10) {
+		printf("func1 loop %i\n", i);
+		++i;
+		taskSleep(500000000ULL);
+	}
+}
+
+static void func2(void) {
+	int i = 0;
+	while (1) {
+		printf("func2 loop %i\n", i);
+		++i;
+		taskSleep(500000000ULL);
+	}
+}
+
+static void func3(void) {
+	int i = 0;
+	while (1) {
+		printf("func3 loop %i\n", i);
+		++i;
+		taskSleep(500000000ULL);
+	}
+}
+
+int main(void) {
+	taskLibInit();
+
+	taskNode_t *new = createTask();
+	initTask(new, func1, 0);
+	taskNode_t *new2 = createTask();
+	initTask(new2, func2, 0);
+	taskNode_t *new3 = createTask();
+	initTask(new3, func3, 0);
+
+	while (1) {
+		printf("main loop\n");
+		taskSleep(500000000ULL);
+	}
+	return 0;
+}
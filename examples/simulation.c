@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* capacity planning in simulation mode: an hour of a request serving workload
+* runs in virtual time for a few quantum sizes; every worker thinks (sleeps)
+* for an exponentially distributed time, then does a CPU burst, reported is
+* throughput and response time (from wake up until the burst is done)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "taskLib.h"
+
+/**********************************/
+/* Global variables */
+
+#define WORKERS 64
+#define THINK_MEAN_NS 200000000.0
+#define BURST_MEAN_NS 2000000.0
+#define SIM_DURATION_NS (3600ULL * 1000000000ULL)
+
+static const unsigned long quanta[] = {1000, 10000, 100000};
+
+static uint64_t simEnd;
+static unsigned long long completed;
+static uint64_t responseSum;
+static uint64_t responseMax;
+
+/**********************************/
+/* Functions definitions */
+
+static double expRand(unsigned int *seed, double mean) {
+	return -mean * log((rand_r(seed) + 1.0) / (RAND_MAX + 2.0));
+}
+
+static void worker(int id) {
+	unsigned int seed = id;
+	while (1) {
+		uint64_t start;
+		taskSleep((uint64_t) expRand(&seed, THINK_MEAN_NS));
+		start = taskTimeNs();
+		if (start >= simEnd) {
+			break;
+		}
+		taskSimWork((uint64_t) expRand(&seed, BURST_MEAN_NS));
+		++completed;
+		responseSum += taskTimeNs() - start;
+		if (taskTimeNs() - start > responseMax) {
+			responseMax = taskTimeNs() - start;
+		}
+	}
+}
+
+int main(void) {
+	taskNode_t *workers[WORKERS];
+	unsigned int q;
+	int i;
+
+	taskLibInit();
+	taskSimEnable();
+	printf("%12s %12s %16s %16s %10s\n", "quantum [us]", "req/s", "mean resp [us]", "max resp [us]", "wall [s]");
+	for (q = 0; q < sizeof(quanta) / sizeof(quanta[0]); ++q) {
+		struct timespec w0, w1;
+		clock_gettime(CLOCK_MONOTONIC, &w0);
+		taskSetQuantum(quanta[q]);
+		simEnd = taskTimeNs() + SIM_DURATION_NS;
+		completed = 0;
+		responseSum = 0;
+		responseMax = 0;
+		for (i = 0; i < WORKERS; ++i) {
+			workers[i] = createTask();
+			initTask(workers[i], (void (*)(void)) worker, 1, i);
+		}
+		for (i = 0; i < WORKERS; ++i) {
+			taskJoin(workers[i]);
+			freeTask(workers[i]);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &w1);
+		printf("%12lu %12.1f %16.1f %16.1f %10.2f\n", quanta[q],
+			completed / (SIM_DURATION_NS / 1e9),
+			completed ? responseSum / 1000.0 / completed : 0.0,
+			responseMax / 1000.0,
+			(w1.tv_sec - w0.tv_sec) + (w1.tv_nsec - w0.tv_nsec) / 1e9);
+	}
+	return 0;
+}
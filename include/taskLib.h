@@ -0,0 +1,456 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TASK_LIB_H
+#define TASK_LIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ucontext.h>
+
+/**********************************/
+/* Types */
+
+typedef enum __taskState_t {
+	ALLOC = 0,
+	READY,
+	RUNNING,
+	BLOCKED,
+	ZOMBIE
+} taskState_t;
+
+typedef enum __waitReason_t {
+	WAIT_NONE = 0,
+	WAIT_MUTEX,
+	WAIT_JOIN,
+	WAIT_SLEEP,
+	WAIT_RCU,
+	WAIT_COMBINE,
+	WAIT_DELEGATE,
+	WAIT_POOL,
+	WAIT_SPAWN,
+	WAIT_DEFER
+} waitReason_t;
+
+//what spawning does when a live task limit is reached
+typedef enum __spawnMode_t {
+	SPAWN_FAIL = 0,
+	SPAWN_BLOCK,
+	SPAWN_QUEUE
+} spawnMode_t;
+
+/*
+* entry of scheduler timer heap, func is called with scheduler blocked
+* once expires time passes; heapPos is 0 when timer is not queued;
+* nonzero period re-arms it at expires + period
+*/
+typedef struct __taskTimer_t {
+	uint64_t expires;
+	uint64_t period;
+	void (*func)(void *arg);
+	void *arg;
+	unsigned int heapPos;
+} taskTimer_t;
+
+/*
+* deferred work item, owned by the caller and queued by taskDefer until the
+* deferred work task runs func; queued is nonzero while it waits
+*/
+typedef struct __taskWork_t {
+	void (*func)(void *arg);
+	void *arg;
+	struct __taskWork_t *next;
+	int queued;
+} taskWork_t;
+
+//callRcu entry, usually embedded in the object to be reclaimed
+typedef struct __rcuHead_t {
+	void (*func)(struct __rcuHead_t *head);
+	struct __rcuHead_t *next;
+	uint64_t gen;
+} rcuHead_t;
+
+//sequence lock, odd sequence while a writer is inside
+typedef struct __taskSeqlock_t {
+	unsigned int seq;
+} taskSeqlock_t;
+
+/*
+* flat combining lock: tasks publish operations and whoever holds the lock
+* runs all published ones; ops and passes tell how much was combined
+*/
+typedef struct __fcRequest_t {
+	void (*func)(void *arg);
+	void *arg;
+	struct __taskNode_t *task;
+	struct __fcRequest_t *next;
+	int done;
+} fcRequest_t;
+
+typedef struct __fcLock_t {
+	int locked;
+	fcRequest_t *pending;
+	unsigned long ops;
+	unsigned long passes;
+} fcLock_t;
+
+/*
+* delegation: closures submitted to the mailbox of an owner task run on that
+* task, which drains them in batches; request is owned by the submitter
+*/
+typedef struct __delegateReq_t {
+	void *(*func)(void *arg);
+	void *arg;
+	void *result;
+	struct __taskNode_t *task;
+	struct __delegateReq_t *next;
+	int done;
+} delegateReq_t;
+
+typedef struct __taskMailbox_t {
+	delegateReq_t *pending;
+	struct __taskNode_t *owner;
+	unsigned long served;
+	unsigned long batches;
+} taskMailbox_t;
+
+/*
+* pool of caller provided items, e.g. connections; released item goes
+* straight to the longest waiting task
+*/
+typedef struct __poolWaiter_t {
+	struct __taskNode_t *task;
+	void *item;
+	struct __poolWaiter_t *next;
+} poolWaiter_t;
+
+typedef struct __taskPool_t {
+	void **items;
+	size_t freeNum;
+	size_t capacity;
+	poolWaiter_t *waitHead;
+	poolWaiter_t *waitTail;
+	unsigned long acquired;
+	unsigned long waited;
+	unsigned long timeouts;
+} taskPool_t;
+
+#define TASK_POOL_FOREVER UINT64_MAX
+
+/*
+* token bucket kept as theoretical arrival time of the next token (GCRA),
+* so it needs no refill timer and costs a few words per bucket
+*/
+typedef struct __tokenBucket_t {
+	uint64_t tat;
+	uint64_t intervalNs;
+	uint64_t burstNs;
+} tokenBucket_t;
+
+#define TOKEN_NO_WAIT UINT64_MAX
+
+typedef enum __taskPerfMode_t {
+	PERF_NONE = 0,
+	PERF_HW,
+	PERF_SW
+} taskPerfMode_t;
+
+#define PERF_EVENTS_NUM 3
+
+typedef struct __taskPerf_t {
+	uint64_t count[PERF_EVENTS_NUM];
+} taskPerf_t;
+
+typedef enum __schedPolicy_t {
+	//round robin among tasks of the highest priority
+	POLICY_PRIO_RR = 0,
+	//round robin ignoring priorities
+	POLICY_RR,
+	//highest priority first, then the longest ready, ticks do not rotate equal ones
+	POLICY_FIFO
+} schedPolicy_t;
+
+typedef enum __traceEventType_t {
+	TRACE_SPAWN = 0,
+	TRACE_BLOCK,
+	TRACE_WAKE,
+	TRACE_EXIT
+} traceEventType_t;
+
+//runNs is cumulative CPU time of the task, arg is parent for spawn, wait reason for block
+typedef struct __taskTraceEvent_t {
+	uint64_t time;
+	uint64_t runNs;
+	unsigned int task;
+	unsigned int arg;
+	traceEventType_t type;
+	int priority;
+} taskTraceEvent_t;
+
+#define TASK_PRIO_DEFAULT 0
+#define TASK_PRIO_MIN (-20)
+
+#define TASK_QUANTUM_DEFAULT_US 1000000
+
+#define WATCHDOG_DEMOTE 1
+
+//taskIsolate flags
+#define ISOLATE_MLOCK 1
+#define ISOLATE_PREFAULT 2
+
+typedef struct __taskNode_t {
+	ucontext_t context;
+	//initTask entry, switched to from inside the task once ticks are unblocked
+	ucontext_t entryCtx;
+	taskState_t tState;
+	unsigned int id;
+	//higher priority tasks run first, equal ones in round robin
+	int priority;
+	//tasks sharing data, nonzero group runs after a task of the same group
+	unsigned int group;
+	//when task became READY, for starvation watchdog
+	uint64_t readySince;
+	//when task was last woken or started, preemption does not change it
+	uint64_t wakeNs;
+	//quanta consumed since last voluntary switch
+	unsigned int runQuanta;
+	int watchdogFlags;
+	//what the task is waiting for: mutex or joined task
+	waitReason_t waitReason;
+	const void *waitOn;
+	taskTimer_t sleepTimer;
+	//RCU read side nesting and generation of the last quiescent state
+	unsigned int rcuNesting;
+	uint64_t rcuQsGen;
+	//run time statistics
+	unsigned long runs;
+	uint64_t runNs;
+	uint64_t lastRunNs;
+	taskPerf_t perf;
+	//taskSpawn entry, queued tasks wait on spawnNext list without a stack
+	void (*entry)(void *arg);
+	void *entryArg;
+	int spawnQueued;
+	struct __taskNode_t *spawnNext;
+	struct __taskNode_t *next;
+	struct __taskNode_t *prev;
+} taskNode_t;
+
+typedef struct __taskList_t {
+	taskNode_t *task;
+	struct __taskList_t *next;
+	struct __taskList_t *prev;
+} taskList_t ;
+
+typedef struct __myMutex_t {
+	int value;
+	taskNode_t *lockedBy;
+	taskList_t taskList;
+} myMutex_t ;
+
+/*
+* counters are only incremented by the scheduler thread, always with SIGALRM
+* blocked, so a tick cannot interrupt an update and no locking is needed
+*/
+typedef struct __taskMetrics_t {
+	//counters
+	uint64_t voluntarySwitches;
+	uint64_t preemptions;
+	uint64_t spawned;
+	uint64_t exited;
+	uint64_t mutexContended;
+	uint64_t shed;
+	//gauges, computed when metrics are pulled
+	unsigned int tasks[ZOMBIE + 1];
+	unsigned int readyQueue;
+	uint64_t stackBytes;
+	unsigned int overloaded;
+} taskMetrics_t;
+
+/**********************************/
+/* User API functions declarations */
+
+void taskLibInit(void);
+taskNode_t *createTask(void);
+int freeTask(taskNode_t *task);
+void taskJoin(const taskNode_t *tWait);
+int taskSetQuantum(unsigned long usec);
+taskNode_t *taskSelf(void);
+uint64_t taskTimeNs(void);
+
+void schedule(void);
+void blockSched(void);
+void unblockSched(void);
+//malloc and free for code running in tasks, see taskAlloc
+void *taskAlloc(size_t size);
+void taskFree(void *ptr);
+
+void taskSleep(uint64_t ns);
+void taskSleepUntil(uint64_t deadlineNs);
+
+int taskTimerStart(taskTimer_t *timer, uint64_t expiresNs, uint64_t periodNs, void (*func)(void *arg), void *arg);
+void taskTimerStop(taskTimer_t *timer);
+
+int taskDefer(taskWork_t *work, void (*func)(void *arg), void *arg);
+
+void rcuReadLock(void);
+void rcuReadUnlock(void);
+void synchronizeRcu(void);
+void callRcu(rcuHead_t *head, void (*func)(rcuHead_t *head));
+
+void fcLockInit(fcLock_t *lock);
+void fcExecute(fcLock_t *lock, void (*func)(void *arg), void *arg);
+
+void mailboxInit(taskMailbox_t *mailbox, taskNode_t *owner);
+void delegateSubmit(taskMailbox_t *mailbox, delegateReq_t *req, void *(*func)(void *arg), void *arg);
+void *delegateWait(delegateReq_t *req);
+void *delegateCall(taskMailbox_t *mailbox, void *(*func)(void *arg), void *arg);
+int delegateServe(taskMailbox_t *mailbox);
+
+int taskPoolInit(taskPool_t *pool, void *const *items, size_t num);
+void taskPoolDestroy(taskPool_t *pool);
+void *taskPoolAcquire(taskPool_t *pool, uint64_t timeoutNs);
+void taskPoolRelease(taskPool_t *pool, void *item);
+
+void taskOverloadControl(uint64_t targetNs, uint64_t intervalNs, uint64_t shedNs);
+int taskOverloaded(void);
+
+int taskSpawnLimit(unsigned int group, unsigned int maxLive, spawnMode_t mode);
+int taskSpawn(taskNode_t *task, void (*func)(void *arg), void *arg);
+
+void tokenBucketInit(tokenBucket_t *bucket, uint64_t ratePerSec, unsigned int burst);
+int tokenBucketTryAcquire(tokenBucket_t *bucket, unsigned int tokens);
+uint64_t tokenBucketAcquire(tokenBucket_t *bucket, unsigned int tokens, uint64_t maxWaitNs);
+
+//publish and read RCU protected pointers
+#define rcuAssignPointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define rcuDereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+
+int taskSimEnable(void);
+void taskSimWork(uint64_t ns);
+
+void initMyMutex(myMutex_t *mutex);
+void lockMutex(myMutex_t *mutex);
+myMutex_t *tryLockMutex(myMutex_t *mutex);
+void unlockMutex(myMutex_t *mutex);
+
+int taskPerfInit(void);
+const char *taskPerfEventName(int event);
+void taskGetPerf(const taskNode_t *task, taskPerf_t *perf);
+
+void taskDumpState(int fd);
+int taskDumpOnSignal(int sig);
+
+void taskGetMetrics(taskMetrics_t *metrics);
+int taskMetricsFormat(char *buf, size_t size);
+taskNode_t *taskMetricsServe(const char *path);
+
+void taskSetPriority(taskNode_t *task, int priority);
+void taskWatchdogSet(uint64_t starveNs, unsigned int maxQuanta, int flags);
+void taskSetPolicy(schedPolicy_t policy);
+void taskSetGroup(taskNode_t *task, unsigned int group);
+
+int taskTraceStart(size_t maxEvents);
+void taskTraceStop(void);
+int taskTraceSave(const char *path);
+
+int taskNumaNodes(void);
+int taskNumaBind(int cpuNode, int memNode);
+int taskIsolate(const char *cpuList, int fifoPriority, int flags);
+
+/*
+* seqlock for small, frequently read state: readers copy the data between
+* seqlockReadBegin and seqlockReadRetry and repeat while the latter is true,
+* writers never block readers and need no mutex or blockSched; a preempted
+* writer leaves the sequence odd, readers then yield to let it finish and
+* back off with a short sleep, so a lower priority writer can run too
+*/
+#define SEQLOCK_YIELDS 4
+#define SEQLOCK_BACKOFF_NS 1000
+
+static inline void seqlockInit(taskSeqlock_t *sl) {
+	sl->seq = 0;
+}
+
+static inline void seqlockWait(unsigned int spins) {
+	if (spins < SEQLOCK_YIELDS) {
+		schedule();
+	}
+	else {
+		taskSleep(SEQLOCK_BACKOFF_NS);
+	}
+}
+
+static inline unsigned int seqlockReadBegin(const taskSeqlock_t *sl) {
+	unsigned int spins = 0;
+	unsigned int seq;
+	while ((seq = __atomic_load_n(&(sl->seq), __ATOMIC_ACQUIRE)) & 1) {
+		seqlockWait(spins++);
+	}
+	return seq;
+}
+
+static inline int seqlockReadRetry(const taskSeqlock_t *sl, unsigned int seq) {
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&(sl->seq), __ATOMIC_RELAXED) != seq;
+}
+
+//writers exclude each other by moving the sequence from even to odd
+static inline void seqlockWriteBegin(taskSeqlock_t *sl) {
+	unsigned int spins = 0;
+	unsigned int seq = __atomic_load_n(&(sl->seq), __ATOMIC_RELAXED);
+	while ((seq & 1) ||
+			!__atomic_compare_exchange_n(&(sl->seq), &seq, seq + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		if (seq & 1) {
+			seqlockWait(spins++);
+			seq = __atomic_load_n(&(sl->seq), __ATOMIC_RELAXED);
+		}
+	}
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seqlockWriteEnd(taskSeqlock_t *sl) {
+	__atomic_store_n(&(sl->seq), sl->seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+* macro is used to be able to pass VA_ARGS to makecontext from calling initTask
+* other approach would be in-line assembly to push vargs to stack before makecontext call
+*/
+#define initTask(newTask, func, argc, ...)									\
+	do {																	\
+		if (!newTask || newTask->tState != ALLOC) break;					\
+		if (prepareTask(newTask) != 0) break;								\
+		makecontext(&(newTask->entryCtx), func, argc, ##__VA_ARGS__);		\
+		startTask(newTask);													\
+	} while (0);
+
+//used by initTask, allocate stack of the new task and put it on scheduler list
+int prepareTask(taskNode_t *newTask);
+void startTask(taskNode_t *newTask);
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* sharded hash map of 64-bit keys to pointers: lookups are lock-free RCU
+* reads, updates lock one shard with its myMutex_t; bucket count is fixed
+* at init, entries are reclaimed with callRcu
+*/
+
+#ifndef TASK_MAP_H
+#define TASK_MAP_H
+
+#include "taskLib.h"
+
+/**********************************/
+/* Types */
+
+typedef struct __taskMapEntry_t {
+	rcuHead_t rcu;
+	struct __taskMapEntry_t *next;
+	uint64_t key;
+	void *value;
+} taskMapEntry_t;
+
+typedef struct __taskMapShard_t {
+	myMutex_t lock;
+	taskMapEntry_t **buckets;
+	size_t bucketMask;
+	size_t count;
+} taskMapShard_t;
+
+typedef struct __taskMap_t {
+	taskMapShard_t *shards;
+	unsigned int shardBits;
+} taskMap_t;
+
+#define TASK_MAP_SHARDS_DEFAULT 16
+
+/**********************************/
+/* User API functions declarations */
+
+int taskMapInit(taskMap_t *map, unsigned int shards, size_t capacity);
+void taskMapDestroy(taskMap_t *map);
+
+void *taskMapGet(taskMap_t *map, uint64_t key);
+int taskMapPut(taskMap_t *map, uint64_t key, void *value);
+void *taskMapRemove(taskMap_t *map, uint64_t key);
+size_t taskMapCount(taskMap_t *map);
+
+size_t taskMapGetMany(taskMap_t *map, const uint64_t *keys, void **values, size_t num);
+int taskMapPutMany(taskMap_t *map, const uint64_t *keys, void *const *values, size_t num);
+void taskMapForEach(taskMap_t *map, void (*func)(uint64_t key, void *value, void *arg), void *arg);
+
+#endif
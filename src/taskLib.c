@@ -0,0 +1,2630 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <execinfo.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sched.h>
+#include <linux/mempolicy.h>
+
+#include "taskLib.h"
+
+//per task watchdog flags, each problem is logged once per episode
+#define WATCHDOG_STARVING 1
+#define WATCHDOG_RUNAWAY 2
+
+#define TASK_STACK_SIZE 16384
+//stack top kept for the initTask entry frame while taskEntry runs below it
+#define TASK_ENTRY_RESERVE 256
+//switches in a row kept within one affinity group before others get a turn
+#define GROUP_RUN_MAX 8
+
+/**********************************/
+/* Internal functions declarations */
+void listInit(taskNode_t *head);
+void listAdd(taskNode_t *head, taskNode_t *node);
+void listRemove(const taskNode_t *head, taskNode_t *node);
+taskNode_t *listGetNext(const taskNode_t *head, const taskNode_t *node);
+
+taskNode_t *switchTasks(int yield);
+taskNode_t *getNextTask(void);
+
+void makeReady(taskNode_t *task);
+static void cleanUpFunc(void);
+static void sigHand (int sig, siginfo_t *siginfo, void *vcontext);
+
+static int perfOpen(unsigned int type, const unsigned long long *config);
+static int perfRead(uint64_t *values);
+static void perfAccount(taskNode_t *task);
+
+static uint64_t getTimeNs(void);
+static void runAccount(taskNode_t *task, uint64_t now);
+static void dumpPrintf(int fd, const char *fmt, ...);
+static void dumpTask(int fd, const taskNode_t *task, const ucontext_t *ctx, uint64_t now);
+static void dumpState(int fd, const ucontext_t *curCtx);
+static void dumpSigHand(int sig, siginfo_t *siginfo, void *vcontext);
+static int dumpWrite(int fd, const char *buf, size_t len);
+
+static int metricsAppend(char *buf, size_t size, int len, const char *fmt, ...);
+static void metricsServeFunc(void);
+
+static void watchdogCheck(const ucontext_t *curCtx);
+
+static int timerAdd(taskTimer_t *timer);
+static void timerDel(taskTimer_t *timer);
+static void timerSiftUp(unsigned int pos);
+static void timerSiftDown(unsigned int pos);
+static void timersRun(uint64_t now);
+static int tickArm(void);
+static void idleWait(void);
+static void sleepWake(void *arg);
+static void simTick(void);
+
+static void traceEvent(traceEventType_t type, const taskNode_t *task, unsigned int arg);
+
+static int cpuListParse(const char *list, cpu_set_t *set);
+static void stackPrefault(const stack_t *stack);
+
+static void deferRun(void);
+static void deferTaskFunc(void);
+static void deferWake(void);
+
+static int rcuGpDone(uint64_t gen);
+static void rcuPoll(void);
+
+static void fcCombine(fcLock_t *lock);
+
+static int stackAlloc(taskNode_t *task);
+static void taskEntry(void);
+static struct __spawnLimit_t *spawnLimitFind(unsigned int group);
+static struct __spawnLimit_t *spawnExceeded(unsigned int group);
+static void spawnCount(const taskNode_t *task, int delta);
+static int spawnReserve(taskNode_t *task, int queue);
+static void spawnEntry(void);
+static void spawnStart(taskNode_t *task);
+static void spawnDrain(void);
+static void overloadCheck(uint64_t now, uint64_t sojourn);
+
+static void delegateWake(taskNode_t *task, const void *waitOn);
+
+/**********************************/
+/* Global variables */
+
+static taskNode_t tSchedListHead;
+static taskNode_t *currTask;
+static taskNode_t *mainTask;
+static ucontext_t cleanUpCtx;
+static unsigned int taskIdSeq;
+static uint64_t switchInNs;
+static taskMetrics_t stats;
+static int metricsListenFd = -1;
+
+static uint64_t watchdogStarveNs;
+static unsigned int watchdogMaxQuanta;
+static int watchdogFlags;
+
+//min-heap of timers ordered by expiry, index 0 is unused
+static taskTimer_t **timerHeap;
+static unsigned int timerHeapSize;
+static unsigned int timerHeapCap;
+//callbacks run inside the scheduler, where unblocking it is not allowed
+static int timersRunning;
+
+//simulation mode: clock is virtual, advanced by taskSimWork() and idling
+static int simMode;
+static uint64_t simNow;
+static uint64_t simQuantumNs = TASK_QUANTUM_DEFAULT_US * 1000ULL;
+static uint64_t simSliceUsed;
+
+//real time ticks: one shot ITIMER_REAL armed for the quantum end or first timer
+static uint64_t quantumNs;
+static uint64_t nextTickNs;
+static uint64_t tickArmedNs;
+
+static schedPolicy_t schedPolicy = POLICY_PRIO_RR;
+static unsigned int groupRun;
+//task of higher priority than the running one was woken up
+static int needResched;
+
+static int prefaultStacks;
+
+/*
+* live task limits, entry 0 is for all tasks, others for task groups; live
+* tasks are counted from admission until exit, main task is not counted
+*/
+#define SPAWN_LIMITS_MAX 16
+
+typedef struct __spawnLimit_t {
+	unsigned int group;
+	unsigned int maxLive;
+	unsigned int live;
+	spawnMode_t mode;
+} spawnLimit_t;
+
+static spawnLimit_t spawnLimits[SPAWN_LIMITS_MAX];
+static unsigned int spawnLimitsNum = 1;
+static taskNode_t *spawnQueueHead;
+static taskNode_t *spawnQueueTail;
+
+//overload control, disabled while target is zero
+static uint64_t overloadTargetNs;
+static uint64_t overloadIntervalNs;
+static uint64_t overloadShedNs;
+//minimum ready queue delay of tasks dequeued since windowStart
+static uint64_t overloadWindowStart;
+static uint64_t overloadMinSojourn;
+static int overloaded;
+
+//combiner gives the lock up after that many batches, to bound its latency
+#define FC_PASSES_MAX 8
+
+//deferred work pushed lock-free, newest first
+static taskWork_t *deferHead;
+//runs deferred work, put on the task list when the first item is queued
+static taskNode_t deferTask;
+static char deferStack[TASK_STACK_SIZE];
+
+//every grace period request takes a new generation
+static uint64_t rcuGen;
+static int rcuWaiters;
+static rcuHead_t *rcuCbHead;
+static rcuHead_t **rcuCbTail = &rcuCbHead;
+static int rcuCbRunning;
+
+//trace recording stops when the buffer is full, so it always starts at the beginning
+static taskTraceEvent_t *traceBuf;
+static size_t traceLen;
+static size_t traceCap;
+static unsigned long traceDropped;
+
+static taskPerfMode_t perfMode = PERF_NONE;
+static int perfFd[PERF_EVENTS_NUM] = {-1, -1, -1};
+static struct perf_event_mmap_page *perfPage[PERF_EVENTS_NUM];
+static uint64_t perfLast[PERF_EVENTS_NUM];
+
+static const unsigned long long perfHwEvents[PERF_EVENTS_NUM] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES
+};
+static const unsigned long long perfSwEvents[PERF_EVENTS_NUM] = {
+	PERF_COUNT_SW_TASK_CLOCK,
+	PERF_COUNT_SW_PAGE_FAULTS,
+	PERF_COUNT_SW_CONTEXT_SWITCHES
+};
+static const char *perfEventNames[][PERF_EVENTS_NUM] = {
+	{"none", "none", "none"},
+	{"cycles", "instructions", "cache-misses"},
+	{"task-clock", "page-faults", "context-switches"}
+};
+
+/**********************************/
+/* Functions definitions */
+
+void initMyMutex(myMutex_t *mutex) {
+	mutex->value = 0;
+	mutex->lockedBy = NULL;
+	mutex->taskList.next = &(mutex->taskList);
+	mutex->taskList.prev = &(mutex->taskList);
+	mutex->taskList.task = NULL;
+}
+
+void lockMutex(myMutex_t *mutex) {
+	blockSched();
+	if (mutex->value != 0) {
+		++stats.mutexContended;
+		//add to waiting queue
+		taskList_t myNode;
+		myNode.task = currTask;
+		myNode.prev = mutex->taskList.prev;
+		myNode.next = &(mutex->taskList);
+		mutex->taskList.prev->next = &myNode;
+		mutex->taskList.prev = &myNode;
+		currTask->waitReason = WAIT_MUTEX;
+		currTask->waitOn = mutex;
+
+		while (mutex->value != 0) {
+			currTask->tState = BLOCKED;
+			unblockSched();
+			schedule();
+			blockSched();
+		}
+
+		//remove from waiting queue
+		myNode.prev->next = myNode.next;
+		myNode.next->prev = myNode.prev;
+		currTask->waitReason = WAIT_NONE;
+		currTask->waitOn = NULL;
+	}
+	mutex->value = 1;
+	mutex->lockedBy = currTask;
+	unblockSched();
+}
+
+myMutex_t *tryLockMutex(myMutex_t *mutex) {
+	myMutex_t * ret = NULL;
+	blockSched();
+	if (mutex->value == 0) {
+		mutex->value = 1;
+		mutex->lockedBy = currTask;
+		ret = mutex;
+	}
+	unblockSched();
+	return ret;
+}
+
+void unlockMutex(myMutex_t *mutex) {
+	blockSched();
+	if (mutex->value != 0 && mutex->lockedBy == currTask) {
+		mutex->value = 0;
+		//notify all waiting processes
+		taskList_t *nextT = mutex->taskList.next;
+		while (nextT != &(mutex->taskList)) {
+			makeReady(nextT->task);
+			nextT = nextT->next;
+		}
+	}
+	unblockSched();
+}
+
+void listInit(taskNode_t *head) {
+	head->next = head;
+	head->prev = head;
+}
+
+void listAdd(taskNode_t *head, taskNode_t *node) {
+	head->prev->next = node;
+	node->prev = head->prev;
+	node->next = head;
+	head->prev = node;
+}
+
+void listRemove(const taskNode_t *head, taskNode_t *node) {
+	if (head != node) {
+		node->next->prev = node->prev;
+		node->prev->next = node->next;
+	}
+}
+
+taskNode_t *listGetNext(const taskNode_t *head, const taskNode_t *node) {
+	taskNode_t *nextNode = node->next;
+	while (nextNode == head) {
+		nextNode = nextNode->next;
+	}
+	return nextNode;
+}
+
+void taskLibInit(void) {
+	struct sigaction sigH = {0,};
+	sigH.sa_sigaction = &sigHand;
+	sigH.sa_flags = SA_SIGINFO;
+	sigaction(SIGALRM, &sigH, NULL);
+
+	listInit(&tSchedListHead);
+
+	//create current, main task
+	currTask = (taskNode_t*) taskAlloc(sizeof(taskNode_t));
+	mainTask = currTask;
+	getcontext(&(currTask->context));
+	currTask->tState = RUNNING;
+	currTask->runs = 1;
+	switchInNs = getTimeNs();
+	listAdd(&tSchedListHead, currTask);
+
+	//create clean up context, entered with scheduler blocked from the start
+	getcontext(&cleanUpCtx);
+	sigaddset(&(cleanUpCtx.uc_sigmask), SIGALRM);
+	cleanUpCtx.uc_stack.ss_sp = taskAlloc(TASK_STACK_SIZE * sizeof(char));
+	cleanUpCtx.uc_stack.ss_size = TASK_STACK_SIZE * sizeof(char);
+	cleanUpCtx.uc_link = &(mainTask->context);
+	makecontext(&cleanUpCtx, cleanUpFunc, 0);
+
+	//deferred work task, it never ends and goes before all other tasks
+	getcontext(&(deferTask.context));
+	sigaddset(&(deferTask.context.uc_sigmask), SIGALRM);
+	deferTask.context.uc_stack.ss_sp = deferStack;
+	deferTask.context.uc_stack.ss_size = sizeof(deferStack);
+	deferTask.context.uc_link = &cleanUpCtx;
+	makecontext(&(deferTask.context), deferTaskFunc, 0);
+	deferTask.tState = BLOCKED;
+	deferTask.waitReason = WAIT_DEFER;
+	deferTask.priority = INT_MAX;
+
+	taskSetQuantum(TASK_QUANTUM_DEFAULT_US);
+}
+
+//time slice of preemptive scheduling, 0 disables preemption
+int taskSetQuantum(unsigned long usec) {
+	int ret;
+	simQuantumNs = usec * 1000ULL;
+	if (simMode) {
+		return 0;
+	}
+	blockSched();
+	quantumNs = usec * 1000ULL;
+	nextTickNs = getTimeNs() + quantumNs;
+	//armed deadline may belong to the old quantum
+	tickArmedNs = 0;
+	ret = tickArm();
+	unblockSched();
+	return ret;
+}
+
+void cleanUpFunc(void) {
+	while (1) {
+		//state saved to cleanUpCtx below keeps scheduler blocked for next ones
+		blockSched();
+		perfAccount(currTask);
+		runAccount(currTask, getTimeNs());
+		listRemove(&tSchedListHead, currTask);
+		currTask->tState = ZOMBIE;
+		++stats.exited;
+		if (traceBuf) {
+			traceEvent(TRACE_EXIT, currTask, 0);
+		}
+		//wake up tasks joining this one
+		{
+			taskNode_t *task = &tSchedListHead;
+			while ((task = task->next) != &tSchedListHead) {
+				if (task->waitReason == WAIT_JOIN && task->waitOn == currTask && task->tState == BLOCKED) {
+					makeReady(task);
+				}
+			}
+		}
+		//we are on clean up stack, so the one of ended task can go
+		taskFree(currTask->context.uc_stack.ss_sp);
+		currTask->context.uc_stack.ss_sp = NULL;
+		spawnCount(currTask, -1);
+		spawnDrain();
+		//current task has ended
+		currTask = NULL;
+		currTask = getNextTask();
+		needResched = 0;
+		currTask->tState = RUNNING;
+		currTask->runs++;
+		swapcontext(&cleanUpCtx, &(currTask->context));
+	}
+}
+
+void blockSched(void) {
+	sigset_t mask;
+	sigemptyset (&mask);
+	sigaddset (&mask, SIGALRM); 
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+}
+
+/*
+* end of a critical section is a preemption point: when a wakeup made a higher
+* priority task ready, switch to it now as a tick arriving here would do
+*/
+void unblockSched(void) {
+	sigset_t mask;
+	if (needResched && currTask->tState == RUNNING) {
+		taskNode_t *oldTask;
+		blockSched();
+		oldTask = switchTasks(0);
+		++stats.preemptions;
+		if (oldTask != currTask) {
+			swapcontext(&(oldTask->context), &(currTask->context));
+		}
+	}
+	sigemptyset (&mask);
+	sigaddset (&mask, SIGALRM); 
+	sigprocmask(SIG_UNBLOCK, &mask, NULL);
+}
+
+/*
+* allocator is not reentrant, a tick must not switch to a task entering it
+* again; previous mask is restored, so these also work with scheduler
+* blocked, memory is zeroed
+*/
+void *taskAlloc(size_t size) {
+	sigset_t mask;
+	sigset_t old;
+	void *ptr;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGALRM);
+	sigprocmask(SIG_BLOCK, &mask, &old);
+	ptr = calloc(1, size);
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	return ptr;
+}
+
+void taskFree(void *ptr) {
+	sigset_t mask;
+	sigset_t old;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGALRM);
+	sigprocmask(SIG_BLOCK, &mask, &old);
+	free(ptr);
+	sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+taskNode_t *createTask(void) {
+	taskNode_t *newTask = (taskNode_t*) taskAlloc(sizeof(taskNode_t));
+	if (newTask) {
+		blockSched();
+		newTask->tState = ALLOC;
+		newTask->id = ++taskIdSeq;
+		unblockSched();
+	}
+	return newTask;
+}
+
+//task can be freed when it has not been started or has already ended
+int freeTask(taskNode_t *task) {
+	if (!task || task->spawnQueued || (task->tState != ALLOC && task->tState != ZOMBIE)) {
+		return -1;
+	}
+	taskFree(task);
+	return 0;
+}
+
+/*
+* task starts with scheduler blocked; swapcontext restores the signal
+* mask before it loads the registers, a tick inside would save over
+* the context being loaded
+*/
+static int stackAlloc(taskNode_t *task) {
+	getcontext(&(task->context));
+	sigaddset(&(task->context.uc_sigmask), SIGALRM);
+	task->context.uc_stack.ss_sp = taskAlloc(TASK_STACK_SIZE * sizeof(char));
+	if (!task->context.uc_stack.ss_sp) {
+		return -1;
+	}
+	task->context.uc_stack.ss_size = TASK_STACK_SIZE * sizeof(char);
+	if (prefaultStacks) {
+		stackPrefault(&(task->context.uc_stack));
+	}
+	task->context.uc_link = &cleanUpCtx;
+	return 0;
+}
+
+/*
+* initTask tasks start here with scheduler blocked; once it is unblocked
+* a tick inside setcontext saves to context, not to entryCtx being loaded
+*/
+static void taskEntry(void) {
+	unblockSched();
+	setcontext(&(currTask->entryCtx));
+}
+
+//over a limit in SPAWN_QUEUE mode initTask blocks, its arguments cannot be queued
+int prepareTask(taskNode_t *newTask) {
+	if (newTask->spawnQueued || spawnReserve(newTask, 0) != 0) {
+		return -1;
+	}
+	if (stackAlloc(newTask) != 0) {
+		spawnCount(newTask, -1);
+		unblockSched();
+		return -1;
+	}
+	//initTask makes the entry context, taskEntry switches to it
+	getcontext(&(newTask->entryCtx));
+	sigdelset(&(newTask->entryCtx.uc_sigmask), SIGALRM);
+	newTask->entryCtx.uc_stack = newTask->context.uc_stack;
+	newTask->entryCtx.uc_link = &cleanUpCtx;
+	//top of the stack is left to the entry context and its arguments
+	newTask->context.uc_stack.ss_size -= TASK_ENTRY_RESERVE;
+	makecontext(&(newTask->context), taskEntry, 0);
+	newTask->context.uc_stack.ss_size += TASK_ENTRY_RESERVE;
+	unblockSched();
+	return 0;
+}
+
+void startTask(taskNode_t *newTask) {
+	blockSched();
+	makeReady(newTask);
+	listAdd(&tSchedListHead, newTask);
+	++stats.spawned;
+	if (traceBuf) {
+		traceEvent(TRACE_SPAWN, newTask, currTask->id);
+	}
+	unblockSched();
+	schedule();
+}
+
+taskNode_t *taskSelf(void) {
+	return currTask;
+}
+
+uint64_t taskTimeNs(void) {
+	return getTimeNs();
+}
+
+/*
+* mask saved by swapcontext keeps scheduler blocked until the task is
+* switched back here, tasks preempted in sigHand get theirs from sigreturn
+*/
+void schedule(void) {
+	taskNode_t *oldTask;
+	if (!currTask->rcuNesting) {
+		currTask->rcuQsGen = rcuGen;
+	}
+	if (rcuCbHead) {
+		rcuPoll();
+	}
+	blockSched();
+	currTask->runQuanta = 0;
+	currTask->watchdogFlags = 0;
+	oldTask = switchTasks(1);
+	++stats.voluntarySwitches;
+#ifdef DEBUG
+	printf("schedule\n");
+#endif
+	swapcontext(&(oldTask->context), &(currTask->context));
+	unblockSched();
+}
+
+//group is the one preferred now, zero for none
+static int isBetterTask(const taskNode_t *task, const taskNode_t *best, unsigned int group) {
+	if (!best) {
+		return 1;
+	}
+	if (schedPolicy != POLICY_RR && task->priority != best->priority) {
+		return task->priority > best->priority;
+	}
+	//current task does not count as a group mate, it would never be preempted
+	if (group && (task->group == group && task != currTask) != (best->group == group && best != currTask)) {
+		return task->group == group && task != currTask;
+	}
+	//overloaded queue serves newly woken tasks LIFO, so most wait little and the old ones long
+	if (overloaded && task != currTask && best != currTask && task->wakeNs != best->wakeNs) {
+		return task->wakeNs > best->wakeNs;
+	}
+	if (schedPolicy == POLICY_FIFO) {
+		return task->readySince < best->readySince;
+	}
+	//round robin, first one after the current task wins
+	return 0;
+}
+
+//scheduling algorithm goes here, picked by schedPolicy
+taskNode_t *getNextTask(void) {
+	taskNode_t *start;
+	taskNode_t *nextTask;
+	taskNode_t *best = NULL;
+	unsigned int group = 0;
+	uint64_t now = getTimeNs();
+	if (currTask == NULL) {
+		start = &tSchedListHead;
+	}
+	else {
+		start = currTask;
+		if (groupRun < GROUP_RUN_MAX) {
+			group = currTask->group;
+		}
+	}
+	timersRun(now);
+	//current task is checked last, so equal priority ones take turns
+	while (1) {
+		deferWake();
+		nextTask = start;
+		do {
+			nextTask = nextTask->next;
+			if (nextTask != &tSchedListHead &&
+					(nextTask->tState == READY || nextTask->tState == RUNNING) &&
+					isBetterTask(nextTask, best, group)) {
+				best = nextTask;
+			}
+		} while (nextTask != start);
+		if (best) {
+			if (best != currTask) {
+				if (overloadTargetNs && best->tState == READY) {
+					overloadCheck(now, now - best->readySince);
+				}
+				groupRun = (currTask && best->group && best->group == currTask->group) ? groupRun + 1 : 0;
+			}
+			return best;
+		}
+		//empty queue ends overload, as in CoDel
+		overloadWindowStart = 0;
+		overloaded = 0;
+		idleWait();
+		now = getTimeNs();
+	}
+}
+
+void makeReady(taskNode_t *task) {
+	if (traceBuf && task->tState == BLOCKED) {
+		traceEvent(TRACE_WAKE, task, 0);
+	}
+	task->tState = READY;
+	task->readySince = getTimeNs();
+	task->wakeNs = task->readySince;
+	if (currTask && currTask->tState == RUNNING && schedPolicy != POLICY_RR && task->priority > currTask->priority) {
+		needResched = 1;
+	}
+}
+
+taskNode_t *switchTasks(int yield) {
+	taskNode_t *oldTask = currTask;
+	uint64_t now = getTimeNs();
+	perfAccount(oldTask);
+	runAccount(oldTask, now);
+	if (oldTask->tState == BLOCKED && traceBuf) {
+		traceEvent(TRACE_BLOCK, oldTask, oldTask->waitReason);
+	}
+	//yielding task goes behind the other ready ones in FIFO order
+	if (yield && oldTask->tState == RUNNING) {
+		oldTask->readySince = now;
+	}
+	currTask = getNextTask();
+	//timers run by getNextTask may have woken tasks, they are accounted for
+	needResched = 0;
+	//blocked task stays blocked until someone wakes it up
+	if (oldTask->tState == RUNNING) {
+		oldTask->tState = READY;
+		oldTask->readySince = now;
+	}
+	currTask->tState = RUNNING;
+	currTask->runs++;
+	currTask->watchdogFlags &= ~WATCHDOG_STARVING;
+	simSliceUsed = 0;
+	return oldTask;
+}
+
+void taskJoin(const taskNode_t *tWait) {
+	if (tWait) {
+		blockSched();
+		currTask->waitReason = WAIT_JOIN;
+		currTask->waitOn = tWait;
+		//ending task wakes us up in cleanUpFunc
+		while (tWait->tState != ZOMBIE) {
+			currTask->tState = BLOCKED;
+			unblockSched();
+			schedule();
+			blockSched();
+		}
+		currTask->waitReason = WAIT_NONE;
+		currTask->waitOn = NULL;
+		unblockSched();
+	}
+}
+
+/*
+* tasks are switched from inside the handler, interrupted task keeps its
+* signal frame on its own stack and all registers are restored by sigreturn
+* once it is switched back in
+*/
+static void sigHand (int sig, siginfo_t *siginfo, void *vcontext) {
+	taskNode_t *oldTask;
+	uint64_t now = getTimeNs();
+#ifdef DEBUG
+	printf("signal handle\n");
+#endif
+	tickArmedNs = 0;
+	//raise() or kill() asks for a switch right away, also with ticks off
+	if (siginfo->si_code == SI_USER || siginfo->si_code == SI_TKILL) {
+		++currTask->runQuanta;
+	}
+	//timer due inside the quantum, task is switched only for a more important one it woke
+	else if (!quantumNs || now < nextTickNs) {
+		timersRun(now);
+		deferWake();
+		if (!needResched) {
+			tickArm();
+			return;
+		}
+	}
+	else {
+		//late tick does not shift the next ones, they stay on the quantum grid
+		nextTickNs += ((now - nextTickNs) / quantumNs + 1) * quantumNs;
+		++currTask->runQuanta;
+		watchdogCheck((const ucontext_t*) vcontext);
+	}
+	oldTask = switchTasks(0);
+	++stats.preemptions;
+	tickArm();
+	swapcontext(&(oldTask->context), &(currTask->context));
+}
+
+void taskSetPriority(taskNode_t *task, int priority) {
+	blockSched();
+	task->priority = priority;
+	unblockSched();
+}
+
+/*
+* on every tick flags READY tasks waiting longer than starveNs and the
+* running task when it used more than maxQuanta without yielding, stack
+* of flagged task is logged once per episode; with WATCHDOG_DEMOTE runaway
+* task loses one priority level each time; zero disables given check
+*/
+void taskWatchdogSet(uint64_t starveNs, unsigned int maxQuanta, int flags) {
+	blockSched();
+	watchdogStarveNs = starveNs;
+	watchdogMaxQuanta = maxQuanta;
+	watchdogFlags = flags;
+	unblockSched();
+}
+
+static void watchdogCheck(const ucontext_t *curCtx) {
+	taskNode_t *task = &tSchedListHead;
+	uint64_t now;
+	if (!watchdogStarveNs && !watchdogMaxQuanta) {
+		return;
+	}
+	now = getTimeNs();
+	if (watchdogMaxQuanta && currTask->runQuanta > watchdogMaxQuanta &&
+			!(currTask->watchdogFlags & WATCHDOG_RUNAWAY)) {
+		currTask->watchdogFlags |= WATCHDOG_RUNAWAY;
+		dumpPrintf(STDERR_FILENO, "watchdog: task %u ran %u quanta without yielding\n",
+			currTask->id, currTask->runQuanta);
+		dumpTask(STDERR_FILENO, currTask, curCtx, now);
+		if ((watchdogFlags & WATCHDOG_DEMOTE) && currTask->priority > TASK_PRIO_MIN) {
+			--currTask->priority;
+			//give it another maxQuanta at the new level before demoting again
+			currTask->runQuanta = 0;
+			currTask->watchdogFlags &= ~WATCHDOG_RUNAWAY;
+			dumpPrintf(STDERR_FILENO, "watchdog: task %u demoted to priority %d\n",
+				currTask->id, currTask->priority);
+		}
+	}
+	if (!watchdogStarveNs) {
+		return;
+	}
+	while ((task = task->next) != &tSchedListHead) {
+		if (task->tState == READY && now - task->readySince > watchdogStarveNs &&
+				!(task->watchdogFlags & WATCHDOG_STARVING)) {
+			task->watchdogFlags |= WATCHDOG_STARVING;
+			dumpPrintf(STDERR_FILENO, "watchdog: task %u ready for %llu us without running\n",
+				task->id, (unsigned long long) ((now - task->readySince) / 1000));
+			dumpTask(STDERR_FILENO, task, &(task->context), now);
+		}
+	}
+}
+
+/*
+* per task performance counters, opened once for the whole process thread
+* and read at every switch, the delta since the previous switch goes to
+* the outgoing task; when there is no hardware PMU (VMs, containers)
+* software events are used instead
+*/
+int taskPerfInit(void) {
+	int i;
+	if (perfMode != PERF_NONE) {
+		return perfMode;
+	}
+	if (perfOpen(PERF_TYPE_HARDWARE, perfHwEvents) == 0) {
+		perfMode = PERF_HW;
+	}
+	else if (perfOpen(PERF_TYPE_SOFTWARE, perfSwEvents) == 0) {
+		perfMode = PERF_SW;
+	}
+	else {
+		return PERF_NONE;
+	}
+
+	//map user pages of hw counters so they can be read with rdpmc
+	if (perfMode == PERF_HW) {
+		for (i = 0; i < PERF_EVENTS_NUM; ++i) {
+			void *page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, perfFd[i], 0);
+			perfPage[i] = (page == MAP_FAILED) ? NULL : (struct perf_event_mmap_page*) page;
+		}
+	}
+
+	blockSched();
+	perfRead(perfLast);
+	unblockSched();
+	return perfMode;
+}
+
+const char *taskPerfEventName(int event) {
+	if (event < 0 || event >= PERF_EVENTS_NUM) {
+		return NULL;
+	}
+	return perfEventNames[perfMode][event];
+}
+
+void taskGetPerf(const taskNode_t *task, taskPerf_t *perf) {
+	blockSched();
+	*perf = task->perf;
+	//add what the running task collected since it was switched in
+	if (task == currTask && perfMode != PERF_NONE) {
+		uint64_t now[PERF_EVENTS_NUM];
+		int i;
+		if (perfRead(now) == 0) {
+			for (i = 0; i < PERF_EVENTS_NUM; ++i) {
+				perf->count[i] += now[i] - perfLast[i];
+			}
+		}
+	}
+	unblockSched();
+}
+
+static int perfOpen(unsigned int type, const unsigned long long *config) {
+	int i;
+	for (i = 0; i < PERF_EVENTS_NUM; ++i) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config[i];
+		attr.read_format = PERF_FORMAT_GROUP;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		//first event is the group leader, the rest is read together with it
+		perfFd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, i ? perfFd[0] : -1, 0);
+		if (perfFd[i] < 0) {
+			while (i-- > 0) {
+				close(perfFd[i]);
+				perfFd[i] = -1;
+			}
+			return -1;
+		}
+	}
+	return 0;
+}
+
+#if defined(__x86_64__)
+static int perfRdpmc(const struct perf_event_mmap_page *pc, uint64_t *value) {
+	unsigned int seq, idx, low, high;
+	uint64_t count;
+	int shift;
+	do {
+		seq = pc->lock;
+		__asm__ volatile("" ::: "memory");
+		idx = pc->index;
+		if (!pc->cap_user_rdpmc || idx == 0) {
+			return -1;
+		}
+		count = pc->offset;
+		__asm__ volatile("rdpmc" : "=a" (low), "=d" (high) : "c" (idx - 1));
+		//sign extend counter of pmc_width bits
+		shift = 64 - pc->pmc_width;
+		count += (uint64_t) (((int64_t) (((uint64_t) high << 32) | low) << shift) >> shift);
+		__asm__ volatile("" ::: "memory");
+	} while (pc->lock != seq);
+	*value = count;
+	return 0;
+}
+#endif
+
+static int perfRead(uint64_t *values) {
+	//group read format is: nr, value[nr]
+	uint64_t buf[PERF_EVENTS_NUM + 1];
+#if defined(__x86_64__)
+	if (perfPage[0]) {
+		int i;
+		for (i = 0; i < PERF_EVENTS_NUM; ++i) {
+			if (!perfPage[i] || perfRdpmc(perfPage[i], &(buf[i + 1])) != 0) {
+				break;
+			}
+		}
+		if (i == PERF_EVENTS_NUM) {
+			memcpy(values, buf + 1, PERF_EVENTS_NUM * sizeof(uint64_t));
+			return 0;
+		}
+	}
+#endif
+	if (read(perfFd[0], buf, sizeof(buf)) != sizeof(buf)) {
+		return -1;
+	}
+	memcpy(values, buf + 1, PERF_EVENTS_NUM * sizeof(uint64_t));
+	return 0;
+}
+
+static void perfAccount(taskNode_t *task) {
+	uint64_t now[PERF_EVENTS_NUM];
+	int i;
+	if (perfMode == PERF_NONE || perfRead(now) != 0) {
+		return;
+	}
+	for (i = 0; i < PERF_EVENTS_NUM; ++i) {
+		task->perf.count[i] += now[i] - perfLast[i];
+		perfLast[i] = now[i];
+	}
+}
+
+static uint64_t getTimeNs(void) {
+	struct timespec ts;
+	if (simMode) {
+		return simNow;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void runAccount(taskNode_t *task, uint64_t now) {
+	task->runNs += now - switchInNs;
+	task->lastRunNs = now;
+	switchInNs = now;
+}
+
+/*
+* state dump may be called from a signal handler so it formats into a local
+* buffer and writes it out with write(), without stdio locks or malloc
+*/
+static void dumpPrintf(int fd, const char *fmt, ...) {
+	char buf[256];
+	va_list args;
+	int len;
+	va_start(args, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	if (len > (int) sizeof(buf) - 1) {
+		len = sizeof(buf) - 1;
+	}
+	if (len > 0) {
+		write(fd, buf, len);
+	}
+}
+
+#define DUMP_FRAMES_MAX 32
+
+/*
+* walks saved frame pointers of the task, so frames compiled with
+* -fomit-frame-pointer are skipped or end the walk early
+*/
+static void dumpTask(int fd, const taskNode_t *task, const ucontext_t *ctx, uint64_t now) {
+	static const char *stateNames[] = {"ALLOC", "READY", "RUNNING", "BLOCKED", "ZOMBIE"};
+	void *frames[DUMP_FRAMES_MAX];
+	int nFrames = 0;
+	uint64_t runNs = task->runNs;
+	ucontext_t selfCtx;
+
+	if (task == currTask) {
+		runNs += now - switchInNs;
+	}
+
+	dumpPrintf(fd, "task %u (%p): %s%s, runs %lu, run time %llu us",
+		task->id, (void*) task, stateNames[task->tState],
+		task == currTask ? " (current)" : "", task->runs,
+		(unsigned long long) (runNs / 1000));
+	if (task != currTask && task->lastRunNs) {
+		dumpPrintf(fd, ", last ran %llu us ago", (unsigned long long) ((now - task->lastRunNs) / 1000));
+	}
+	if (task->waitReason == WAIT_MUTEX) {
+		const myMutex_t *mutex = (const myMutex_t*) task->waitOn;
+		dumpPrintf(fd, ", waits for mutex %p held by task %u", task->waitOn,
+			mutex->lockedBy ? mutex->lockedBy->id : 0);
+	}
+	else if (task->waitReason == WAIT_JOIN) {
+		dumpPrintf(fd, ", joins task %u", ((const taskNode_t*) task->waitOn)->id);
+	}
+	else if (task->waitReason == WAIT_SLEEP && task->sleepTimer.expires > now) {
+		dumpPrintf(fd, ", sleeps for %llu us more", (unsigned long long) ((task->sleepTimer.expires - now) / 1000));
+	}
+	else if (task->waitReason == WAIT_RCU) {
+		dumpPrintf(fd, ", waits for RCU grace period");
+	}
+	else if (task->waitReason == WAIT_COMBINE) {
+		dumpPrintf(fd, ", waits for combining lock %p", task->waitOn);
+	}
+	else if (task->waitReason == WAIT_DELEGATE) {
+		dumpPrintf(fd, ", waits for delegated work %p", task->waitOn);
+	}
+	else if (task->waitReason == WAIT_POOL) {
+		dumpPrintf(fd, ", waits for pool %p", task->waitOn);
+	}
+	else if (task->waitReason == WAIT_SPAWN) {
+		dumpPrintf(fd, ", waits for spawn admission");
+	}
+	else if (task->waitReason == WAIT_DEFER) {
+		dumpPrintf(fd, ", waits for deferred work");
+	}
+	if (task->rcuNesting) {
+		dumpPrintf(fd, ", in RCU read section");
+	}
+	dumpPrintf(fd, "\n");
+
+	if (task->tState == ALLOC || task->tState == ZOMBIE) {
+		return;
+	}
+	//no saved context given, the current task dumps itself
+	if (!ctx) {
+		getcontext(&selfCtx);
+		ctx = &selfCtx;
+	}
+	{
+		uintptr_t fp = ctx->uc_mcontext.gregs[REG_RBP];
+		uintptr_t lo = ctx->uc_mcontext.gregs[REG_RSP];
+		uintptr_t hi = lo + (1 << 20);
+		//task stacks have known bounds, main one is limited to 1 MiB above sp
+		if (task->context.uc_stack.ss_sp) {
+			lo = (uintptr_t) task->context.uc_stack.ss_sp;
+			hi = lo + task->context.uc_stack.ss_size;
+		}
+		frames[nFrames++] = (void*) ctx->uc_mcontext.gregs[REG_RIP];
+		while (nFrames < DUMP_FRAMES_MAX && fp >= lo && fp + 2 * sizeof(uintptr_t) <= hi && !(fp & 7)) {
+			const uintptr_t *frame = (const uintptr_t*) fp;
+			if (!frame[1]) {
+				break;
+			}
+			frames[nFrames++] = (void*) frame[1];
+			if (frame[0] <= fp) {
+				break;
+			}
+			fp = frame[0];
+		}
+	}
+	backtrace_symbols_fd(frames, nFrames, fd);
+}
+
+static void dumpState(int fd, const ucontext_t *curCtx) {
+	const taskNode_t *task = &tSchedListHead;
+	uint64_t now = getTimeNs();
+	dumpPrintf(fd, "---- task dump, current task %u ----\n", currTask ? currTask->id : 0);
+	while ((task = task->next) != &tSchedListHead) {
+		if (task == currTask) {
+			dumpTask(fd, task, curCtx, now);
+		}
+		else {
+			dumpTask(fd, task, &(task->context), now);
+		}
+	}
+	dumpPrintf(fd, "---- end of task dump ----\n");
+}
+
+static void dumpSigHand(int sig, siginfo_t *siginfo, void *vcontext) {
+	dumpState(STDERR_FILENO, (const ucontext_t*) vcontext);
+}
+
+//other tasks run while fd is not writable, so a slow reader does not stall them
+static int dumpWrite(int fd, const char *buf, size_t len) {
+	while (len) {
+		ssize_t ret = write(fd, buf, len);
+		if (ret < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				return -1;
+			}
+			schedule();
+			continue;
+		}
+		buf += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+/*
+* writes state, wait reason, statistics and backtrace of every task to fd,
+* can be called from a task serving a control socket; the dump is taken
+* into a memory file with scheduler blocked and written out unblocked, so
+* fd may be non-blocking
+*/
+void taskDumpState(int fd) {
+	char buf[1024];
+	ssize_t len;
+	int memFd = memfd_create("taskDump", MFD_CLOEXEC);
+	if (memFd < 0) {
+		blockSched();
+		dumpState(fd, NULL);
+		unblockSched();
+		return;
+	}
+	blockSched();
+	dumpState(memFd, NULL);
+	unblockSched();
+	lseek(memFd, 0, SEEK_SET);
+	while ((len = read(memFd, buf, sizeof(buf))) > 0) {
+		if (dumpWrite(fd, buf, len) != 0) {
+			break;
+		}
+	}
+	close(memFd);
+}
+
+/*
+* installs handler dumping all tasks to stderr when sig arrives (e.g. SIGUSR1),
+* scheduler signal is masked during the dump so tasks are not switched
+*/
+int taskDumpOnSignal(int sig) {
+	struct sigaction sigH = {0,};
+	sigH.sa_sigaction = &dumpSigHand;
+	sigH.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&sigH.sa_mask);
+	sigaddset(&sigH.sa_mask, SIGALRM);
+	return sigaction(sig, &sigH, NULL);
+}
+
+void taskGetMetrics(taskMetrics_t *metrics) {
+	const taskNode_t *task = &tSchedListHead;
+	blockSched();
+	*metrics = stats;
+	metrics->overloaded = overloaded;
+	memset(metrics->tasks, 0, sizeof(metrics->tasks));
+	metrics->readyQueue = 0;
+	metrics->stackBytes = cleanUpCtx.uc_stack.ss_size;
+	while ((task = task->next) != &tSchedListHead) {
+		++metrics->tasks[task->tState];
+		if (task->tState == READY) {
+			++metrics->readyQueue;
+		}
+		if (task->context.uc_stack.ss_sp) {
+			metrics->stackBytes += task->context.uc_stack.ss_size;
+		}
+	}
+	metrics->tasks[ZOMBIE] = stats.exited;
+	unblockSched();
+}
+
+static int metricsAppend(char *buf, size_t size, int len, const char *fmt, ...) {
+	va_list args;
+	int ret;
+	if (len < 0 || (size_t) len >= size) {
+		return len;
+	}
+	va_start(args, fmt);
+	ret = vsnprintf(buf + len, size - len, fmt, args);
+	va_end(args);
+	return ret < 0 ? -1 : len + ret;
+}
+
+/*
+* formats metrics in Prometheus text exposition format, returns length of
+* the text or -1 when buf is too small; rates (switches/s, preemptions/s)
+* are left to the scraper, e.g. rate(tasklib_switches_total[1m])
+*/
+int taskMetricsFormat(char *buf, size_t size) {
+	static const char *stateNames[] = {"alloc", "ready", "running", "blocked", "zombie"};
+	taskMetrics_t m;
+	int len = 0;
+	int i;
+	taskGetMetrics(&m);
+
+	len = metricsAppend(buf, size, len,
+		"# HELP tasklib_switches_total Task switches.\n"
+		"# TYPE tasklib_switches_total counter\n"
+		"tasklib_switches_total{kind=\"voluntary\"} %llu\n"
+		"tasklib_switches_total{kind=\"preemption\"} %llu\n",
+		(unsigned long long) m.voluntarySwitches, (unsigned long long) m.preemptions);
+	len = metricsAppend(buf, size, len,
+		"# HELP tasklib_tasks_spawned_total Tasks started.\n"
+		"# TYPE tasklib_tasks_spawned_total counter\n"
+		"tasklib_tasks_spawned_total %llu\n"
+		"# HELP tasklib_tasks_exited_total Tasks finished.\n"
+		"# TYPE tasklib_tasks_exited_total counter\n"
+		"tasklib_tasks_exited_total %llu\n"
+		"# HELP tasklib_mutex_contended_total Mutex locks which had to wait.\n"
+		"# TYPE tasklib_mutex_contended_total counter\n"
+		"tasklib_mutex_contended_total %llu\n"
+		"# HELP tasklib_tasks_shed_total Queued spawns dropped under overload.\n"
+		"# TYPE tasklib_tasks_shed_total counter\n"
+		"tasklib_tasks_shed_total %llu\n",
+		(unsigned long long) m.spawned, (unsigned long long) m.exited,
+		(unsigned long long) m.mutexContended, (unsigned long long) m.shed);
+	len = metricsAppend(buf, size, len,
+		"# HELP tasklib_tasks Tasks by state.\n"
+		"# TYPE tasklib_tasks gauge\n");
+	for (i = ALLOC; i < ZOMBIE; ++i) {
+		len = metricsAppend(buf, size, len, "tasklib_tasks{state=\"%s\"} %u\n", stateNames[i], m.tasks[i]);
+	}
+	len = metricsAppend(buf, size, len,
+		"# HELP tasklib_ready_queue_length Tasks ready to run.\n"
+		"# TYPE tasklib_ready_queue_length gauge\n"
+		"tasklib_ready_queue_length %u\n"
+		"# HELP tasklib_stack_bytes Stack memory of live tasks.\n"
+		"# TYPE tasklib_stack_bytes gauge\n"
+		"tasklib_stack_bytes %llu\n"
+		"# HELP tasklib_overloaded Ready queue delay is over the overload target.\n"
+		"# TYPE tasklib_overloaded gauge\n"
+		"tasklib_overloaded %u\n",
+		m.readyQueue, (unsigned long long) m.stackBytes, m.overloaded);
+
+	return (len < 0 || (size_t) len >= size) ? -1 : len;
+}
+
+#define METRICS_POLL_NS 10000000ULL
+
+static void metricsServeFunc(void) {
+	//static, task stacks are too small for it
+	static char buf[8192];
+	while (1) {
+		int len, i;
+		//accepted socket does not block either, writes yield instead
+		int fd = accept4(metricsListenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			//nothing to serve, let other tasks run
+			taskSleep(METRICS_POLL_NS);
+			continue;
+		}
+		//request is small, give the client a few turns to send it
+		len = 0;
+		for (i = 0; i < 16 && len <= 0; ++i) {
+			len = recv(fd, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+			if (len <= 0) {
+				schedule();
+			}
+		}
+		if (len > 0 && strncmp(buf, "GET /dump", 9) == 0) {
+			static const char hdr[] = "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n\r\n";
+			if (dumpWrite(fd, hdr, sizeof(hdr) - 1) == 0) {
+				taskDumpState(fd);
+			}
+		}
+		else {
+			static const char hdr[] = "HTTP/1.0 200 OK\r\n"
+				"Content-Type: text/plain; version=0.0.4\r\n\r\n";
+			len = taskMetricsFormat(buf, sizeof(buf));
+			if (dumpWrite(fd, hdr, sizeof(hdr) - 1) == 0 && len > 0) {
+				dumpWrite(fd, buf, len);
+			}
+		}
+		close(fd);
+	}
+}
+
+/*
+* starts a task serving metrics over HTTP on a unix socket at path,
+* GET /dump returns the task state dump instead
+*/
+taskNode_t *taskMetricsServe(const char *path) {
+	struct sockaddr_un addr;
+	taskNode_t *server;
+	if (metricsListenFd >= 0 || strlen(path) >= sizeof(addr.sun_path)) {
+		return NULL;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	metricsListenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (metricsListenFd < 0) {
+		return NULL;
+	}
+	unlink(path);
+	if (bind(metricsListenFd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+			listen(metricsListenFd, 16) != 0) {
+		close(metricsListenFd);
+		metricsListenFd = -1;
+		return NULL;
+	}
+	server = createTask();
+	initTask(server, metricsServeFunc, 0);
+	return server;
+}
+
+static void timerSiftUp(unsigned int pos) {
+	taskTimer_t *timer = timerHeap[pos];
+	while (pos > 1 && timerHeap[pos / 2]->expires > timer->expires) {
+		timerHeap[pos] = timerHeap[pos / 2];
+		timerHeap[pos]->heapPos = pos;
+		pos /= 2;
+	}
+	timerHeap[pos] = timer;
+	timer->heapPos = pos;
+}
+
+static void timerSiftDown(unsigned int pos) {
+	taskTimer_t *timer = timerHeap[pos];
+	while (2 * pos <= timerHeapSize) {
+		unsigned int child = 2 * pos;
+		if (child < timerHeapSize && timerHeap[child + 1]->expires < timerHeap[child]->expires) {
+			++child;
+		}
+		if (timerHeap[child]->expires >= timer->expires) {
+			break;
+		}
+		timerHeap[pos] = timerHeap[child];
+		timerHeap[pos]->heapPos = pos;
+		pos = child;
+	}
+	timerHeap[pos] = timer;
+	timer->heapPos = pos;
+}
+
+/*
+* must be called with scheduler blocked, like the rest of timer functions;
+* heap is not grown from callbacks, they may run in the signal handler
+*/
+static int timerAdd(taskTimer_t *timer) {
+	if (timer->heapPos) {
+		timerDel(timer);
+	}
+	if (timerHeapSize + 1 >= timerHeapCap) {
+		unsigned int cap = timerHeapCap ? 2 * timerHeapCap : 64;
+		taskTimer_t **heap;
+		if (timersRunning) {
+			return -1;
+		}
+		heap = (taskTimer_t**) taskAlloc(cap * sizeof(taskTimer_t*));
+		if (!heap) {
+			return -1;
+		}
+		if (timerHeap) {
+			memcpy(heap, timerHeap, timerHeapCap * sizeof(taskTimer_t*));
+		}
+		taskFree(timerHeap);
+		timerHeap = heap;
+		timerHeapCap = cap;
+	}
+	timerHeap[++timerHeapSize] = timer;
+	timerSiftUp(timerHeapSize);
+	if (timer->heapPos == 1) {
+		tickArm();
+	}
+	return 0;
+}
+
+static void timerDel(taskTimer_t *timer) {
+	unsigned int pos = timer->heapPos;
+	if (!pos) {
+		return;
+	}
+	timer->heapPos = 0;
+	if (pos == timerHeapSize--) {
+		return;
+	}
+	//move last one into the hole and restore heap order
+	timer = timerHeap[timerHeapSize + 1];
+	timerHeap[pos] = timer;
+	timer->heapPos = pos;
+	timerSiftUp(pos);
+	timerSiftDown(timer->heapPos);
+}
+
+/*
+* all timers expired by now run as one batch in expiry order; periodic one
+* is re-armed before its callback, so the callback may stop it, and stays
+* on its release grid, releases missed while the scheduler was busy are
+* skipped rather than run in a burst
+*/
+static void timersRun(uint64_t now) {
+	timersRunning = 1;
+	while (timerHeapSize && timerHeap[1]->expires <= now) {
+		taskTimer_t *timer = timerHeap[1];
+		timerDel(timer);
+		if (timer->period) {
+			timer->expires += ((now - timer->expires) / timer->period + 1) * timer->period;
+			timerAdd(timer);
+		}
+		timer->func(timer->arg);
+	}
+	timersRunning = 0;
+}
+
+/*
+* called with scheduler blocked when the first timer may have got earlier
+* and from sigHand; a deadline armed earlier is kept, when it fires sigHand
+* just arms the next one, so removed timers need no re-arming
+*/
+static int tickArm(void) {
+	struct itimerval it;
+	uint64_t deadline = quantumNs ? nextTickNs : UINT64_MAX;
+	uint64_t now;
+	uint64_t usec;
+	if (timerHeapSize && timerHeap[1]->expires < deadline) {
+		deadline = timerHeap[1]->expires;
+	}
+	if (simMode || (tickArmedNs && tickArmedNs <= deadline)) {
+		return 0;
+	}
+	memset(&it, 0, sizeof(it));
+	tickArmedNs = 0;
+	if (deadline != UINT64_MAX) {
+		now = getTimeNs();
+		//rounded up so it never fires before the deadline, zero would disarm it
+		usec = deadline > now ? (deadline - now + 999) / 1000 : 1;
+		it.it_value.tv_sec = usec / 1000000;
+		it.it_value.tv_usec = usec % 1000000;
+		tickArmedNs = now + usec * 1000;
+	}
+	return setitimer(ITIMER_REAL, &it, NULL);
+}
+
+/*
+* callback timer without a task: func runs at expiresNs (taskTimeNs clock)
+* and then every periodNs if it is nonzero, on the stack of whichever task
+* is running or switched out, with scheduler blocked, so it must be short and
+* must not block or use other task API than these timer calls; preemption
+* timer is armed for it, so it fires between scheduling points too;
+* timer memory belongs to the caller and starting a queued timer moves it;
+* started from a callback it fails with -1 if the timer heap would need to
+* grow, callbacks may run in the signal handler where malloc is not safe
+*/
+int taskTimerStart(taskTimer_t *timer, uint64_t expiresNs, uint64_t periodNs, void (*func)(void *arg), void *arg) {
+	int ret;
+	int nested = timersRunning;
+	if (!nested) {
+		blockSched();
+	}
+	timer->expires = expiresNs;
+	timer->period = periodNs;
+	timer->func = func;
+	timer->arg = arg;
+	ret = timerAdd(timer);
+	if (!nested) {
+		unblockSched();
+	}
+	return ret;
+}
+
+//may be called from timer callbacks, also from the timer's own one
+void taskTimerStop(taskTimer_t *timer) {
+	int nested = timersRunning;
+	if (!nested) {
+		blockSched();
+	}
+	timer->period = 0;
+	timerDel(timer);
+	if (!nested) {
+		unblockSched();
+	}
+}
+
+/*
+* nothing to run: wait for the earliest timer, in simulation mode virtual
+* clock just jumps to it; without timers nobody can wake tasks up, so we keep
+* looking like the scheduler always did
+*/
+static void idleWait(void) {
+	uint64_t next;
+	if (!timerHeapSize) {
+		return;
+	}
+	next = timerHeap[1]->expires;
+	if (simMode) {
+		if (next > simNow) {
+			simNow = next;
+		}
+	}
+	else {
+		struct timespec ts;
+		ts.tv_sec = next / 1000000000ULL;
+		ts.tv_nsec = next % 1000000000ULL;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+	//idle time is not accounted to the task that runs next
+	switchInNs = getTimeNs();
+	timersRun(switchInNs);
+}
+
+static void sleepWake(void *arg) {
+	taskNode_t *task = (taskNode_t*) arg;
+	if (task->tState == BLOCKED) {
+		makeReady(task);
+	}
+}
+
+/*
+* in normal mode sleep resolution is bound by scheduling points: ticks,
+* voluntary switches and idling
+*/
+void taskSleepUntil(uint64_t deadlineNs) {
+	blockSched();
+	currTask->sleepTimer.expires = deadlineNs;
+	currTask->sleepTimer.func = sleepWake;
+	currTask->sleepTimer.arg = currTask;
+	if (deadlineNs > getTimeNs() && timerAdd(&(currTask->sleepTimer)) == 0) {
+		currTask->waitReason = WAIT_SLEEP;
+		while (currTask->sleepTimer.heapPos) {
+			currTask->tState = BLOCKED;
+			unblockSched();
+			schedule();
+			blockSched();
+		}
+		currTask->waitReason = WAIT_NONE;
+	}
+	unblockSched();
+}
+
+void taskSleep(uint64_t ns) {
+	taskSleepUntil(getTimeNs() + ns);
+}
+
+/*
+* switches the scheduler to virtual time starting at 0: sleeps and timers
+* advance it when all tasks wait, tasks declare CPU work with taskSimWork()
+* and quantum ticks happen when declared work uses up the time slice;
+* real preemption timer is stopped
+*/
+int taskSimEnable(void) {
+	struct itimerval stop;
+	memset(&stop, 0, sizeof(stop));
+	blockSched();
+	if (setitimer(ITIMER_REAL, &stop, NULL) != 0) {
+		unblockSched();
+		return -1;
+	}
+	tickArmedNs = 0;
+	simMode = 1;
+	simNow = 0;
+	simSliceUsed = 0;
+	switchInNs = 0;
+	unblockSched();
+	return 0;
+}
+
+//in normal mode the work is done by spinning for given time
+void taskSimWork(uint64_t ns) {
+	if (!simMode) {
+		uint64_t end = getTimeNs() + ns;
+		while (getTimeNs() < end) {
+		}
+		return;
+	}
+	while (ns) {
+		uint64_t step = ns;
+		//stop at the end of time slice and at the next timer
+		if (simQuantumNs && step > simQuantumNs - simSliceUsed) {
+			step = simQuantumNs - simSliceUsed;
+		}
+		if (timerHeapSize && timerHeap[1]->expires > simNow && step > timerHeap[1]->expires - simNow) {
+			step = timerHeap[1]->expires - simNow;
+		}
+		simNow += step;
+		simSliceUsed += step;
+		ns -= step;
+		//there are no signal ticks in simulation, so no need to block them
+		timersRun(simNow);
+		if (simQuantumNs && simSliceUsed >= simQuantumNs) {
+			simTick();
+		}
+	}
+}
+
+//virtual counterpart of sigHand
+static void simTick(void) {
+	taskNode_t *oldTask;
+	blockSched();
+	++currTask->runQuanta;
+	watchdogCheck(NULL);
+	oldTask = switchTasks(0);
+	++stats.preemptions;
+	swapcontext(&(oldTask->context), &(currTask->context));
+	unblockSched();
+}
+
+void taskSetPolicy(schedPolicy_t policy) {
+	blockSched();
+	schedPolicy = policy;
+	unblockSched();
+}
+
+/*
+* tasks of one group, e.g. using one connection or shard, run back to back
+* when they are ready and of equal priority, at most GROUP_RUN_MAX switches
+* in a row; zero removes the task from its group
+*/
+void taskSetGroup(taskNode_t *task, unsigned int group) {
+	blockSched();
+	task->group = group;
+	unblockSched();
+}
+
+//called with scheduler blocked
+static void traceEvent(traceEventType_t type, const taskNode_t *task, unsigned int arg) {
+	taskTraceEvent_t *ev;
+	if (traceLen == traceCap) {
+		++traceDropped;
+		return;
+	}
+	ev = &(traceBuf[traceLen++]);
+	ev->time = getTimeNs();
+	ev->runNs = task->runNs;
+	ev->task = task->id;
+	ev->arg = arg;
+	ev->type = type;
+	ev->priority = task->priority;
+}
+
+/*
+* records spawn, block, wake and exit of tasks with their CPU time into
+* a buffer of maxEvents, for offline replay of the scheduling load
+*/
+int taskTraceStart(size_t maxEvents) {
+	taskTraceEvent_t *buf;
+	if (!maxEvents) {
+		return -1;
+	}
+	buf = (taskTraceEvent_t*) taskAlloc(maxEvents * sizeof(taskTraceEvent_t));
+	if (!buf) {
+		return -1;
+	}
+	blockSched();
+	taskFree(traceBuf);
+	traceBuf = buf;
+	traceCap = maxEvents;
+	traceLen = 0;
+	traceDropped = 0;
+	unblockSched();
+	return 0;
+}
+
+//keeps recorded events, they can still be saved
+void taskTraceStop(void) {
+	blockSched();
+	traceCap = traceLen;
+	unblockSched();
+}
+
+/*
+* text format, one event per line:
+* time_ns event task run_ns priority arg
+*/
+int taskTraceSave(const char *path) {
+	static const char *eventNames[] = {"spawn", "block", "wake", "exit"};
+	FILE *out;
+	size_t i, len;
+	if (!traceBuf) {
+		return -1;
+	}
+	out = fopen(path, "w");
+	if (!out) {
+		return -1;
+	}
+	blockSched();
+	len = traceLen;
+	unblockSched();
+	fprintf(out, "# tasklib trace v1, dropped %lu\n# time_ns event task run_ns priority arg\n", traceDropped);
+	for (i = 0; i < len; ++i) {
+		const taskTraceEvent_t *ev = &(traceBuf[i]);
+		fprintf(out, "%llu %s %u %llu %d %u\n", (unsigned long long) ev->time, eventNames[ev->type],
+			ev->task, (unsigned long long) ev->runNs, ev->priority, ev->arg);
+	}
+	return fclose(out);
+}
+
+//parses kernel cpu list format, e.g. "0-3,8,10-11"
+static int cpuListParse(const char *list, cpu_set_t *set) {
+	const char *p = list;
+	CPU_ZERO(set);
+	while (*p && *p != '\n') {
+		char *end;
+		unsigned long first, last;
+		first = strtoul(p, &end, 10);
+		if (end == p) {
+			return -1;
+		}
+		last = first;
+		if (*end == '-') {
+			p = end + 1;
+			last = strtoul(p, &end, 10);
+			if (end == p || last < first) {
+				return -1;
+			}
+		}
+		for (; first <= last && first < CPU_SETSIZE; ++first) {
+			CPU_SET(first, set);
+		}
+		p = (*end == ',') ? end + 1 : end;
+	}
+	return CPU_COUNT(set) ? 0 : -1;
+}
+
+//number of NUMA nodes, 1 when the kernel does not report any
+int taskNumaNodes(void) {
+	char path[64];
+	int nodes = 0;
+	while (1) {
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", nodes);
+		if (access(path, F_OK) != 0) {
+			break;
+		}
+		++nodes;
+	}
+	return nodes ? nodes : 1;
+}
+
+/*
+* pins the scheduler thread to CPUs of cpuNode and makes memNode preferred
+* for its new pages, so control blocks and stacks allocated from now on
+* are local when both nodes are the same; memory freed earlier and reused
+* by malloc stays where it was first touched; negative node keeps setting
+*/
+int taskNumaBind(int cpuNode, int memNode) {
+	char path[64];
+	char list[1024];
+	cpu_set_t set;
+	ssize_t len;
+	int fd;
+	if (cpuNode >= 0) {
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", cpuNode);
+		fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			return -1;
+		}
+		len = read(fd, list, sizeof(list) - 1);
+		close(fd);
+		if (len <= 0) {
+			return -1;
+		}
+		list[len] = '\0';
+		if (cpuListParse(list, &set) != 0 || sched_setaffinity(0, sizeof(set), &set) != 0) {
+			return -1;
+		}
+	}
+	if (memNode >= 0) {
+		unsigned long mask[16] = {0,};
+		if (memNode >= (int) (sizeof(mask) * 8)) {
+			return -1;
+		}
+		mask[memNode / (sizeof(unsigned long) * 8)] = 1UL << (memNode % (sizeof(unsigned long) * 8));
+		if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, sizeof(mask) * 8) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+* calloc may leave fresh pages unmapped, first use would fault inside the task;
+* stack may be in use, so every page gets its own value written back
+*/
+static void stackPrefault(const stack_t *stack) {
+	volatile char *p = (volatile char*) stack->ss_sp;
+	long page = sysconf(_SC_PAGESIZE);
+	size_t off;
+	for (off = 0; off < stack->ss_size; off += page) {
+		p[off] = p[off];
+	}
+}
+
+/*
+* setup for a scheduler on isolated cores: pins the thread to cpuList
+* (kernel format, e.g. "2-3"), with nonzero fifoPriority switches it to
+* SCHED_FIFO, ISOLATE_MLOCK locks current and future memory and
+* ISOLATE_PREFAULT touches stacks of existing and new tasks; NULL cpuList
+* keeps affinity; stops at the first step failing, with errno set
+*/
+int taskIsolate(const char *cpuList, int fifoPriority, int flags) {
+	taskNode_t *task;
+	if (cpuList) {
+		cpu_set_t set;
+		if (cpuListParse(cpuList, &set) != 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+			return -1;
+		}
+	}
+	if (fifoPriority) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = fifoPriority;
+		if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+			return -1;
+		}
+	}
+	if ((flags & ISOLATE_MLOCK) && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		return -1;
+	}
+	if (flags & ISOLATE_PREFAULT) {
+		blockSched();
+		prefaultStacks = 1;
+		stackPrefault(&(cleanUpCtx.uc_stack));
+		task = &tSchedListHead;
+		while ((task = task->next) != &tSchedListHead) {
+			if (task->context.uc_stack.ss_sp && task != mainTask) {
+				stackPrefault(&(task->context.uc_stack));
+			}
+		}
+		unblockSched();
+	}
+	return 0;
+}
+
+/*
+* queues func(arg) to run in the deferred work task, which is woken at the
+* next task switch or timer tick and goes before all other tasks; func runs
+* with scheduler unblocked, so it may block, later items wait for it; it
+* only does two atomic operations, so it can be used from signal handlers,
+* timer callbacks and critical sections; fails when the item is queued already
+*/
+int taskDefer(taskWork_t *work, void (*func)(void *arg), void *arg) {
+	int idle = 0;
+	if (!__atomic_compare_exchange_n(&(work->queued), &idle, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		return -1;
+	}
+	work->func = func;
+	work->arg = arg;
+	work->next = __atomic_load_n(&deferHead, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&deferHead, &(work->next), work, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+	}
+	return 0;
+}
+
+/*
+* called with scheduler blocked from every switch and tick, the first item
+* puts the task on the task list, so programs not deferring never see it
+*/
+static void deferWake(void) {
+	if (!__atomic_load_n(&deferHead, __ATOMIC_RELAXED) || deferTask.tState != BLOCKED) {
+		return;
+	}
+	if (!deferTask.id) {
+		deferTask.id = ++taskIdSeq;
+		listAdd(&tSchedListHead, &deferTask);
+	}
+	deferTask.waitReason = WAIT_NONE;
+	makeReady(&deferTask);
+}
+
+//starts with scheduler blocked like other tasks, an item pushed after the check is seen by deferWake
+static void deferTaskFunc(void) {
+	unblockSched();
+	while (1) {
+		deferRun();
+		blockSched();
+		if (!deferHead) {
+			currTask->waitReason = WAIT_DEFER;
+			currTask->tState = BLOCKED;
+		}
+		unblockSched();
+		schedule();
+	}
+}
+
+//takes the whole queue at once, items pushed meanwhile wait for the next drain
+static void deferRun(void) {
+	taskWork_t *work = __atomic_exchange_n(&deferHead, NULL, __ATOMIC_ACQUIRE);
+	taskWork_t *fifo = NULL;
+	//under overload newest items go first, as they were pushed
+	if (overloaded) {
+		fifo = work;
+		work = NULL;
+	}
+	while (work) {
+		taskWork_t *next = work->next;
+		work->next = fifo;
+		fifo = work;
+		work = next;
+	}
+	while (fifo) {
+		taskWork_t *next = fifo->next;
+		void (*func)(void *arg) = fifo->func;
+		void *arg = fifo->arg;
+		//item may be queued again by its own func
+		__atomic_store_n(&(fifo->queued), 0, __ATOMIC_RELEASE);
+		func(arg);
+		fifo = next;
+	}
+}
+
+/*
+* RCU read side: a task is quiescent whenever it is outside of a read section,
+* voluntary switches record it as well; marking is a plain per task counter,
+* all tasks run on one thread, so preempted readers are seen by writers
+*/
+void rcuReadLock(void) {
+	++currTask->rcuNesting;
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+void rcuReadUnlock(void) {
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	if (--currTask->rcuNesting == 0) {
+		currTask->rcuQsGen = rcuGen;
+		if (rcuWaiters) {
+			taskNode_t *task = &tSchedListHead;
+			blockSched();
+			while ((task = task->next) != &tSchedListHead) {
+				if (task->waitReason == WAIT_RCU && task->tState == BLOCKED) {
+					makeReady(task);
+				}
+			}
+			unblockSched();
+		}
+	}
+}
+
+//readers inside a section that started before gen have all left it
+static int rcuGpDone(uint64_t gen) {
+	taskNode_t *task = &tSchedListHead;
+	while ((task = task->next) != &tSchedListHead) {
+		if (task->rcuNesting && task->rcuQsGen < gen) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+* runs callbacks of completed grace periods, in task context with scheduler
+* blocked, so callbacks may free memory but must not block
+*/
+static void rcuPoll(void) {
+	rcuHead_t *done = NULL;
+	rcuHead_t **tail = &rcuCbHead;
+	blockSched();
+	//generations grow along the list, so done ones form its head
+	while (*tail && rcuGpDone((*tail)->gen)) {
+		tail = &((*tail)->next);
+	}
+	if (tail != &rcuCbHead) {
+		done = rcuCbHead;
+		rcuCbHead = *tail;
+		*tail = NULL;
+		if (!rcuCbHead) {
+			rcuCbTail = &rcuCbHead;
+		}
+	}
+	rcuCbRunning = 1;
+	while (done) {
+		rcuHead_t *next = done->next;
+		done->func(done);
+		done = next;
+	}
+	rcuCbRunning = 0;
+	unblockSched();
+}
+
+/*
+* waits until every reader that could see the old version is done; must not
+* be called from a read section
+*/
+void synchronizeRcu(void) {
+	uint64_t gen;
+	blockSched();
+	gen = ++rcuGen;
+	currTask->rcuQsGen = gen;
+	if (!rcuGpDone(gen)) {
+		++rcuWaiters;
+		currTask->waitReason = WAIT_RCU;
+		while (!rcuGpDone(gen)) {
+			currTask->tState = BLOCKED;
+			unblockSched();
+			schedule();
+			blockSched();
+		}
+		currTask->waitReason = WAIT_NONE;
+		--rcuWaiters;
+	}
+	unblockSched();
+}
+
+/*
+* func is called with head after a grace period, from a voluntary switch
+* with scheduler blocked; it must not block or use other task API than
+* callRcu, e.g. to reclaim the next object of a chain
+*/
+void callRcu(rcuHead_t *head, void (*func)(rcuHead_t *head)) {
+	int nested = rcuCbRunning;
+	if (!nested) {
+		blockSched();
+	}
+	head->func = func;
+	head->next = NULL;
+	head->gen = ++rcuGen;
+	*rcuCbTail = head;
+	rcuCbTail = &(head->next);
+	if (!nested) {
+		unblockSched();
+	}
+}
+
+void fcLockInit(fcLock_t *lock) {
+	memset(lock, 0, sizeof(fcLock_t));
+}
+
+/*
+* lock holder takes published requests in batches and runs them in order,
+* tasks blocked on the lock are woken when their request is done
+*/
+static void fcCombine(fcLock_t *lock) {
+	int pass;
+	for (pass = 0; pass < FC_PASSES_MAX; ++pass) {
+		fcRequest_t *req = __atomic_exchange_n(&(lock->pending), NULL, __ATOMIC_ACQUIRE);
+		fcRequest_t *fifo = NULL;
+		fcRequest_t *next;
+		if (!req) {
+			break;
+		}
+		while (req) {
+			next = req->next;
+			req->next = fifo;
+			fifo = req;
+			req = next;
+		}
+		++lock->passes;
+		for (req = fifo; req; req = next) {
+			//request lives on its task's stack, once done that task may return
+			taskNode_t *task = req->task;
+			next = req->next;
+			req->func(req->arg);
+			++lock->ops;
+			__atomic_store_n(&(req->done), 1, __ATOMIC_RELEASE);
+			//only tasks which gave up waiting need the scheduler
+			if (task != currTask && task->tState == BLOCKED) {
+				blockSched();
+				if (task->tState == BLOCKED && task->waitOn == lock) {
+					makeReady(task);
+				}
+				unblockSched();
+			}
+		}
+	}
+}
+
+/*
+* runs func(arg) under the lock, possibly by another task holding it; all
+* waiters depend on the holder, so func must be short and must not block
+*/
+void fcExecute(fcLock_t *lock, void (*func)(void *arg), void *arg) {
+	fcRequest_t req;
+	int unlocked;
+	req.func = func;
+	req.arg = arg;
+	req.task = currTask;
+	req.done = 0;
+	req.next = __atomic_load_n(&(lock->pending), __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&(lock->pending), &(req.next), &req, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+	}
+	while (!__atomic_load_n(&(req.done), __ATOMIC_ACQUIRE)) {
+		unlocked = 0;
+		if (__atomic_compare_exchange_n(&(lock->locked), &unlocked, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			fcCombine(lock);
+			__atomic_store_n(&(lock->locked), 0, __ATOMIC_RELEASE);
+			//requests left after the last pass: let their tasks take over
+			if (__atomic_load_n(&(lock->pending), __ATOMIC_ACQUIRE)) {
+				taskNode_t *task = &tSchedListHead;
+				blockSched();
+				while ((task = task->next) != &tSchedListHead) {
+					if (task->waitReason == WAIT_COMBINE && task->waitOn == lock && task->tState == BLOCKED) {
+						makeReady(task);
+					}
+				}
+				unblockSched();
+			}
+			continue;
+		}
+		//holder was preempted, wait until it runs our request or unlocks
+		blockSched();
+		if (!req.done && lock->locked) {
+			currTask->waitReason = WAIT_COMBINE;
+			currTask->waitOn = lock;
+			currTask->tState = BLOCKED;
+			unblockSched();
+			schedule();
+			blockSched();
+			currTask->waitReason = WAIT_NONE;
+			currTask->waitOn = NULL;
+		}
+		unblockSched();
+	}
+}
+
+//owner is the task which calls delegateServe on this mailbox
+void mailboxInit(taskMailbox_t *mailbox, taskNode_t *owner) {
+	memset(mailbox, 0, sizeof(taskMailbox_t));
+	mailbox->owner = owner;
+}
+
+static void delegateWake(taskNode_t *task, const void *waitOn) {
+	if (task->tState == BLOCKED) {
+		blockSched();
+		if (task->tState == BLOCKED && task->waitReason == WAIT_DELEGATE && task->waitOn == waitOn) {
+			makeReady(task);
+		}
+		unblockSched();
+	}
+}
+
+/*
+* queues func(arg) for the owner of mailbox; req must stay valid until
+* delegateWait returns; it is a lock-free push, the owner is woken if idle
+*/
+void delegateSubmit(taskMailbox_t *mailbox, delegateReq_t *req, void *(*func)(void *arg), void *arg) {
+	req->func = func;
+	req->arg = arg;
+	req->result = NULL;
+	req->task = currTask;
+	req->done = 0;
+	//owner would wait for itself
+	if (currTask == mailbox->owner) {
+		req->result = func(arg);
+		req->done = 1;
+		return;
+	}
+	req->next = __atomic_load_n(&(mailbox->pending), __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&(mailbox->pending), &(req->next), req, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+	}
+	delegateWake(mailbox->owner, mailbox);
+}
+
+void *delegateWait(delegateReq_t *req) {
+	if (!__atomic_load_n(&(req->done), __ATOMIC_ACQUIRE)) {
+		blockSched();
+		currTask->waitReason = WAIT_DELEGATE;
+		currTask->waitOn = req;
+		while (!__atomic_load_n(&(req->done), __ATOMIC_ACQUIRE)) {
+			currTask->tState = BLOCKED;
+			unblockSched();
+			schedule();
+			blockSched();
+		}
+		currTask->waitReason = WAIT_NONE;
+		currTask->waitOn = NULL;
+		unblockSched();
+	}
+	return req->result;
+}
+
+void *delegateCall(taskMailbox_t *mailbox, void *(*func)(void *arg), void *arg) {
+	delegateReq_t req;
+	delegateSubmit(mailbox, &req, func, arg);
+	return delegateWait(&req);
+}
+
+/*
+* owner side: waits for submissions, then runs all queued ones in order of
+* submission and returns their number
+*/
+int delegateServe(taskMailbox_t *mailbox) {
+	delegateReq_t *req = __atomic_exchange_n(&(mailbox->pending), NULL, __ATOMIC_ACQUIRE);
+	delegateReq_t *fifo = NULL;
+	delegateReq_t *next;
+	int served = 0;
+	if (!req) {
+		//submitter wakes us up after its push, so the check is repeated blocked
+		blockSched();
+		currTask->waitReason = WAIT_DELEGATE;
+		currTask->waitOn = mailbox;
+		while (!__atomic_load_n(&(mailbox->pending), __ATOMIC_ACQUIRE)) {
+			currTask->tState = BLOCKED;
+			unblockSched();
+			schedule();
+			blockSched();
+		}
+		currTask->waitReason = WAIT_NONE;
+		currTask->waitOn = NULL;
+		unblockSched();
+		req = __atomic_exchange_n(&(mailbox->pending), NULL, __ATOMIC_ACQUIRE);
+	}
+	while (req) {
+		next = req->next;
+		req->next = fifo;
+		fifo = req;
+		req = next;
+	}
+	for (req = fifo; req; req = next) {
+		//submitter may return as soon as done is set
+		taskNode_t *task = req->task;
+		next = req->next;
+		req->result = req->func(req->arg);
+		__atomic_store_n(&(req->done), 1, __ATOMIC_RELEASE);
+		delegateWake(task, req);
+		++served;
+	}
+	mailbox->served += served;
+	++mailbox->batches;
+	return served;
+}
+
+//pool keeps its own array of the num items, all of them free; items must not be NULL
+int taskPoolInit(taskPool_t *pool, void *const *items, size_t num) {
+	memset(pool, 0, sizeof(taskPool_t));
+	pool->items = (void**) taskAlloc(num * sizeof(void*));
+	if (!pool->items && num) {
+		return -1;
+	}
+	memcpy(pool->items, items, num * sizeof(void*));
+	pool->freeNum = num;
+	pool->capacity = num;
+	return 0;
+}
+
+//no task may wait on the pool anymore
+void taskPoolDestroy(taskPool_t *pool) {
+	taskFree(pool->items);
+	pool->items = NULL;
+}
+
+/*
+* takes a free item or waits in FIFO order until one is handed over by
+* taskPoolRelease; gives up after timeoutNs returning NULL, 0 never waits,
+* TASK_POOL_FOREVER waits without a timeout
+*/
+void *taskPoolAcquire(taskPool_t *pool, uint64_t timeoutNs) {
+	poolWaiter_t waiter;
+	int timed = timeoutNs != TASK_POOL_FOREVER;
+	blockSched();
+	if (pool->freeNum) {
+		waiter.item = pool->items[--pool->freeNum];
+		++pool->acquired;
+		unblockSched();
+		return waiter.item;
+	}
+	if (!timeoutNs) {
+		unblockSched();
+		return NULL;
+	}
+	waiter.task = currTask;
+	waiter.item = NULL;
+	waiter.next = NULL;
+	if (pool->waitTail) {
+		pool->waitTail->next = &waiter;
+	}
+	else {
+		pool->waitHead = &waiter;
+	}
+	pool->waitTail = &waiter;
+	++pool->waited;
+	if (timed) {
+		currTask->sleepTimer.expires = getTimeNs() + timeoutNs;
+		currTask->sleepTimer.period = 0;
+		currTask->sleepTimer.func = sleepWake;
+		currTask->sleepTimer.arg = currTask;
+		if (timerAdd(&(currTask->sleepTimer)) != 0) {
+			timed = 0;
+		}
+	}
+	currTask->waitReason = WAIT_POOL;
+	currTask->waitOn = pool;
+	while (!waiter.item && (!timed || currTask->sleepTimer.heapPos)) {
+		currTask->tState = BLOCKED;
+		unblockSched();
+		schedule();
+		blockSched();
+	}
+	currTask->waitReason = WAIT_NONE;
+	currTask->waitOn = NULL;
+	timerDel(&(currTask->sleepTimer));
+	if (waiter.item) {
+		++pool->acquired;
+	}
+	else {
+		//timed out, still queued
+		poolWaiter_t *before = NULL;
+		poolWaiter_t *node = pool->waitHead;
+		while (node != &waiter) {
+			before = node;
+			node = node->next;
+		}
+		if (before) {
+			before->next = waiter.next;
+		}
+		else {
+			pool->waitHead = waiter.next;
+		}
+		if (pool->waitTail == &waiter) {
+			pool->waitTail = before;
+		}
+		++pool->timeouts;
+	}
+	unblockSched();
+	return waiter.item;
+}
+
+//hands the item to the longest waiting task, so it cannot be taken over
+void taskPoolRelease(taskPool_t *pool, void *item) {
+	blockSched();
+	if (pool->waitHead) {
+		poolWaiter_t *waiter = pool->waitHead;
+		pool->waitHead = waiter->next;
+		if (!pool->waitHead) {
+			pool->waitTail = NULL;
+		}
+		waiter->item = item;
+		makeReady(waiter->task);
+	}
+	else {
+		pool->items[pool->freeNum++] = item;
+	}
+	unblockSched();
+}
+
+//burst tokens are available at once, then one every 1/ratePerSec seconds
+void tokenBucketInit(tokenBucket_t *bucket, uint64_t ratePerSec, unsigned int burst) {
+	bucket->intervalNs = ratePerSec ? 1000000000ULL / ratePerSec : 0;
+	if (!bucket->intervalNs) {
+		bucket->intervalNs = 1;
+	}
+	bucket->burstNs = (burst ? burst - 1 : 0) * bucket->intervalNs;
+	bucket->tat = 0;
+}
+
+//0 when tokens were taken, -1 when they are not there yet
+int tokenBucketTryAcquire(tokenBucket_t *bucket, unsigned int tokens) {
+	uint64_t now, tat;
+	int ret = -1;
+	blockSched();
+	now = getTimeNs();
+	tat = (bucket->tat > now ? bucket->tat : now) + tokens * bucket->intervalNs;
+	if (tat - bucket->intervalNs <= now + bucket->burstNs) {
+		bucket->tat = tat;
+		ret = 0;
+	}
+	unblockSched();
+	return ret;
+}
+
+/*
+* reserves tokens and parks the task on the timer heap until they are
+* refilled; reservations queue up in order of calls; returns the time
+* waited, or TOKEN_NO_WAIT without reserving when it would exceed maxWaitNs
+*/
+uint64_t tokenBucketAcquire(tokenBucket_t *bucket, unsigned int tokens, uint64_t maxWaitNs) {
+	uint64_t now, tat, ready;
+	blockSched();
+	now = getTimeNs();
+	tat = (bucket->tat > now ? bucket->tat : now) + tokens * bucket->intervalNs;
+	//last token of the request is due at tat - intervalNs, burst may bring it forward
+	ready = tat - bucket->intervalNs;
+	ready = ready > now + bucket->burstNs ? ready - bucket->burstNs : now;
+	if (ready - now > maxWaitNs) {
+		unblockSched();
+		return TOKEN_NO_WAIT;
+	}
+	bucket->tat = tat;
+	unblockSched();
+	if (ready > now) {
+		taskSleepUntil(ready);
+	}
+	return ready - now;
+}
+
+static spawnLimit_t *spawnLimitFind(unsigned int group) {
+	unsigned int i;
+	for (i = 1; i < spawnLimitsNum; ++i) {
+		if (spawnLimits[i].group == group) {
+			return &(spawnLimits[i]);
+		}
+	}
+	return NULL;
+}
+
+//limit which a new task of given group would exceed, NULL when it may start
+static spawnLimit_t *spawnExceeded(unsigned int group) {
+	spawnLimit_t *limit = group ? spawnLimitFind(group) : NULL;
+	if (limit && limit->maxLive && limit->live >= limit->maxLive) {
+		return limit;
+	}
+	if (spawnLimits[0].maxLive && spawnLimits[0].live >= spawnLimits[0].maxLive) {
+		return &(spawnLimits[0]);
+	}
+	return NULL;
+}
+
+//group of a task should not change while it is live, it is counted by it
+static void spawnCount(const taskNode_t *task, int delta) {
+	spawnLimit_t *limit = task->group ? spawnLimitFind(task->group) : NULL;
+	spawnLimits[0].live += delta;
+	if (limit) {
+		limit->live += delta;
+	}
+}
+
+/*
+* admits the task by counting it as live; over a limit it fails with EAGAIN,
+* blocks or, when allowed by queue, returns 1 leaving the task uncounted;
+* unless it fails it returns with scheduler blocked, so the caller starts or
+* queues the task before an exit can drain the queue
+*/
+static int spawnReserve(taskNode_t *task, int queue) {
+	spawnLimit_t *limit;
+	int ret = 0;
+	blockSched();
+	while ((limit = spawnExceeded(task->group))) {
+		if (limit->mode == SPAWN_FAIL) {
+			errno = EAGAIN;
+			ret = -1;
+			break;
+		}
+		if (limit->mode == SPAWN_QUEUE && queue) {
+			ret = 1;
+			break;
+		}
+		currTask->waitReason = WAIT_SPAWN;
+		currTask->tState = BLOCKED;
+		unblockSched();
+		schedule();
+		blockSched();
+		currTask->waitReason = WAIT_NONE;
+	}
+	if (!ret) {
+		spawnCount(task, 1);
+	}
+	if (ret < 0) {
+		unblockSched();
+	}
+	return ret;
+}
+
+/*
+* limits live tasks of group, 0 meaning all tasks, to maxLive, 0 removes
+* the limit; mode tells what spawning over the limit does
+*/
+int taskSpawnLimit(unsigned int group, unsigned int maxLive, spawnMode_t mode) {
+	spawnLimit_t *limit;
+	taskNode_t *task;
+	blockSched();
+	limit = group ? spawnLimitFind(group) : &(spawnLimits[0]);
+	if (!limit) {
+		if (spawnLimitsNum == SPAWN_LIMITS_MAX) {
+			unblockSched();
+			return -1;
+		}
+		limit = &(spawnLimits[spawnLimitsNum++]);
+		limit->group = group;
+		limit->live = 0;
+		task = &tSchedListHead;
+		while ((task = task->next) != &tSchedListHead) {
+			if (task->group == group && task != mainTask) {
+				++limit->live;
+			}
+		}
+	}
+	limit->maxLive = maxLive;
+	limit->mode = mode;
+	//raised limit may admit queued and blocked spawns
+	spawnDrain();
+	unblockSched();
+	return 0;
+}
+
+static void spawnEntry(void) {
+	//new tasks start with scheduler blocked
+	unblockSched();
+	currTask->entry(currTask->entryArg);
+}
+
+//called with scheduler blocked, task is admitted and has its stack
+static void spawnStart(taskNode_t *task) {
+	makecontext(&(task->context), spawnEntry, 0);
+	makeReady(task);
+	listAdd(&tSchedListHead, task);
+	++stats.spawned;
+	if (traceBuf) {
+		traceEvent(TRACE_SPAWN, task, currTask ? currTask->id : 0);
+	}
+}
+
+//called with scheduler blocked when live tasks go down
+static void spawnDrain(void) {
+	taskNode_t *task;
+	taskNode_t **prev = &spawnQueueHead;
+	taskNode_t *last = NULL;
+	uint64_t now = getTimeNs();
+	while ((task = *prev)) {
+		//shed task ends without running, its joiners are woken below
+		if (overloaded && overloadShedNs && now - task->readySince > overloadShedNs) {
+			*prev = task->spawnNext;
+			task->spawnNext = NULL;
+			task->spawnQueued = 0;
+			task->tState = ZOMBIE;
+			++stats.shed;
+			continue;
+		}
+		if (spawnExceeded(task->group) || stackAlloc(task) != 0) {
+			last = task;
+			prev = &(task->spawnNext);
+			continue;
+		}
+		*prev = task->spawnNext;
+		task->spawnNext = NULL;
+		task->spawnQueued = 0;
+		spawnCount(task, 1);
+		spawnStart(task);
+	}
+	spawnQueueTail = last;
+	task = &tSchedListHead;
+	while ((task = task->next) != &tSchedListHead) {
+		if (task->tState == BLOCKED && (task->waitReason == WAIT_SPAWN ||
+				(task->waitReason == WAIT_JOIN && ((const taskNode_t*) task->waitOn)->tState == ZOMBIE))) {
+			makeReady(task);
+		}
+	}
+}
+
+/*
+* starts func(arg) as task, subject to live task limits: returns 0 when it
+* was started, 1 when it was queued and will start once capacity frees up,
+* without a stack until then, -1 when refused or out of memory
+*/
+int taskSpawn(taskNode_t *task, void (*func)(void *arg), void *arg) {
+	int ret;
+	if (!task || task->tState != ALLOC || task->spawnQueued) {
+		return -1;
+	}
+	task->entry = func;
+	task->entryArg = arg;
+	ret = spawnReserve(task, 1);
+	if (ret < 0) {
+		return -1;
+	}
+	if (ret == 1) {
+		task->spawnQueued = 1;
+		task->spawnNext = NULL;
+		task->readySince = getTimeNs();
+		//under overload new work is served first, tail stays where it was
+		if (overloaded && spawnQueueHead) {
+			task->spawnNext = spawnQueueHead;
+			spawnQueueHead = task;
+		}
+		else {
+			if (spawnQueueTail) {
+				spawnQueueTail->spawnNext = task;
+			}
+			else {
+				spawnQueueHead = task;
+			}
+			spawnQueueTail = task;
+		}
+		unblockSched();
+		return 1;
+	}
+	if (stackAlloc(task) != 0) {
+		spawnCount(task, -1);
+		unblockSched();
+		return -1;
+	}
+	spawnStart(task);
+	unblockSched();
+	schedule();
+	return 0;
+}
+
+/*
+* CoDel-style overload detection, called for every task taken off the ready
+* queue: at the end of each interval the queue is overloaded when even the
+* shortest delay seen in it was over target; the minimum ignores short bursts
+* and, unlike the oldest waiting task, still drops under LIFO service once
+* the standing queue is gone, so overload clears again
+*/
+static void overloadCheck(uint64_t now, uint64_t sojourn) {
+	if (!overloadWindowStart) {
+		overloadWindowStart = now;
+		overloadMinSojourn = sojourn;
+		return;
+	}
+	if (sojourn < overloadMinSojourn) {
+		overloadMinSojourn = sojourn;
+	}
+	if (now - overloadWindowStart >= overloadIntervalNs) {
+		overloaded = overloadMinSojourn > overloadTargetNs;
+		overloadWindowStart = now;
+		overloadMinSojourn = sojourn;
+	}
+}
+
+/*
+* under overload ready tasks of equal priority, queued spawns and deferred
+* work are served LIFO; with shedNs set, queued spawns waiting longer are
+* dropped, they end as zombies which never ran; zero targetNs disables it
+*/
+void taskOverloadControl(uint64_t targetNs, uint64_t intervalNs, uint64_t shedNs) {
+	blockSched();
+	overloadTargetNs = targetNs;
+	overloadIntervalNs = intervalNs;
+	overloadShedNs = shedNs;
+	overloadWindowStart = 0;
+	overloaded = 0;
+	unblockSched();
+}
+
+int taskOverloaded(void) {
+	return overloaded;
+}
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "taskMap.h"
+
+/**********************************/
+/* Internal functions declarations */
+
+static uint64_t mapHash(uint64_t key);
+static taskMapShard_t *mapShard(const taskMap_t *map, uint64_t hash);
+static taskMapEntry_t **mapBucket(const taskMapShard_t *shard, uint64_t hash);
+static int mapPutLocked(taskMapShard_t *shard, uint64_t hash, uint64_t key, void *value);
+static void mapEntryFree(rcuHead_t *head);
+
+/**********************************/
+/* Functions definitions */
+
+//splitmix64 finalizer, shard is taken from high bits and bucket from low ones
+static uint64_t mapHash(uint64_t key) {
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebULL;
+	key ^= key >> 31;
+	return key;
+}
+
+static taskMapShard_t *mapShard(const taskMap_t *map, uint64_t hash) {
+	return &(map->shards[map->shardBits ? hash >> (64 - map->shardBits) : 0]);
+}
+
+static taskMapEntry_t **mapBucket(const taskMapShard_t *shard, uint64_t hash) {
+	return &(shard->buckets[hash & shard->bucketMask]);
+}
+
+static void mapEntryFree(rcuHead_t *head) {
+	taskFree(head);
+}
+
+/*
+* shards is rounded up to a power of two, 0 means TASK_MAP_SHARDS_DEFAULT;
+* capacity is the expected number of entries, buckets are not resized later
+*/
+int taskMapInit(taskMap_t *map, unsigned int shards, size_t capacity) {
+	size_t buckets = 1;
+	unsigned int i;
+	if (!shards) {
+		shards = TASK_MAP_SHARDS_DEFAULT;
+	}
+	map->shardBits = 0;
+	while ((1U << map->shardBits) < shards) {
+		++map->shardBits;
+	}
+	shards = 1U << map->shardBits;
+	while (buckets * shards < capacity) {
+		buckets <<= 1;
+	}
+	map->shards = (taskMapShard_t*) taskAlloc(shards * sizeof(taskMapShard_t));
+	for (i = 0; map->shards && i < shards; ++i) {
+		initMyMutex(&(map->shards[i].lock));
+		map->shards[i].bucketMask = buckets - 1;
+		map->shards[i].buckets = (taskMapEntry_t**) taskAlloc(buckets * sizeof(taskMapEntry_t*));
+		if (!map->shards[i].buckets) {
+			break;
+		}
+	}
+	if (!map->shards) {
+		return -1;
+	}
+	if (i < shards) {
+		taskMapDestroy(map);
+		return -1;
+	}
+	return 0;
+}
+
+//no task may use the map anymore, values are not freed
+void taskMapDestroy(taskMap_t *map) {
+	unsigned int i;
+	size_t b;
+	if (!map->shards) {
+		return;
+	}
+	for (i = 0; i < (1U << map->shardBits); ++i) {
+		taskMapShard_t *shard = &(map->shards[i]);
+		if (!shard->buckets) {
+			continue;
+		}
+		for (b = 0; b <= shard->bucketMask; ++b) {
+			taskMapEntry_t *entry = shard->buckets[b];
+			while (entry) {
+				taskMapEntry_t *next = entry->next;
+				taskFree(entry);
+				entry = next;
+			}
+		}
+		taskFree(shard->buckets);
+	}
+	taskFree(map->shards);
+	map->shards = NULL;
+}
+
+/*
+* lock-free, returns NULL when key is not there; lifetime of the value is
+* up to the caller, e.g. freeing it with callRcu after taskMapRemove
+*/
+void *taskMapGet(taskMap_t *map, uint64_t key) {
+	uint64_t hash = mapHash(key);
+	taskMapEntry_t *entry;
+	void *value = NULL;
+	rcuReadLock();
+	entry = rcuDereference(*mapBucket(mapShard(map, hash), hash));
+	while (entry) {
+		if (entry->key == key) {
+			value = rcuDereference(entry->value);
+			break;
+		}
+		entry = rcuDereference(entry->next);
+	}
+	rcuReadUnlock();
+	return value;
+}
+
+//returns 1 for a new key, 0 when the value was replaced, -1 without memory
+static int mapPutLocked(taskMapShard_t *shard, uint64_t hash, uint64_t key, void *value) {
+	taskMapEntry_t **bucket = mapBucket(shard, hash);
+	taskMapEntry_t *entry;
+	for (entry = *bucket; entry; entry = entry->next) {
+		if (entry->key == key) {
+			rcuAssignPointer(entry->value, value);
+			return 0;
+		}
+	}
+	entry = (taskMapEntry_t*) taskAlloc(sizeof(taskMapEntry_t));
+	if (!entry) {
+		return -1;
+	}
+	entry->key = key;
+	entry->value = value;
+	entry->next = *bucket;
+	//readers see either the old head or the complete new entry
+	rcuAssignPointer(*bucket, entry);
+	++shard->count;
+	return 1;
+}
+
+int taskMapPut(taskMap_t *map, uint64_t key, void *value) {
+	uint64_t hash = mapHash(key);
+	taskMapShard_t *shard = mapShard(map, hash);
+	int ret;
+	lockMutex(&(shard->lock));
+	ret = mapPutLocked(shard, hash, key, value);
+	unlockMutex(&(shard->lock));
+	return ret;
+}
+
+//returns the removed value, NULL when key was not there
+void *taskMapRemove(taskMap_t *map, uint64_t key) {
+	uint64_t hash = mapHash(key);
+	taskMapShard_t *shard = mapShard(map, hash);
+	taskMapEntry_t **prev;
+	taskMapEntry_t *entry;
+	void *value = NULL;
+	lockMutex(&(shard->lock));
+	for (prev = mapBucket(shard, hash); (entry = *prev); prev = &(entry->next)) {
+		if (entry->key == key) {
+			//preempted readers on the entry still find their way through next
+			rcuAssignPointer(*prev, entry->next);
+			--shard->count;
+			value = entry->value;
+			callRcu(&(entry->rcu), mapEntryFree);
+			break;
+		}
+	}
+	unlockMutex(&(shard->lock));
+	return value;
+}
+
+size_t taskMapCount(taskMap_t *map) {
+	size_t count = 0;
+	unsigned int i;
+	for (i = 0; i < (1U << map->shardBits); ++i) {
+		count += map->shards[i].count;
+	}
+	return count;
+}
+
+//one read section for the whole batch, returns the number of keys found
+size_t taskMapGetMany(taskMap_t *map, const uint64_t *keys, void **values, size_t num) {
+	size_t found = 0;
+	size_t i;
+	rcuReadLock();
+	for (i = 0; i < num; ++i) {
+		uint64_t hash = mapHash(keys[i]);
+		taskMapEntry_t *entry = rcuDereference(*mapBucket(mapShard(map, hash), hash));
+		values[i] = NULL;
+		while (entry) {
+			if (entry->key == keys[i]) {
+				values[i] = rcuDereference(entry->value);
+				++found;
+				break;
+			}
+			entry = rcuDereference(entry->next);
+		}
+	}
+	rcuReadUnlock();
+	return found;
+}
+
+/*
+* shard lock is kept over runs of keys falling into the same shard, so
+* batches grouped by shard take each lock once; stops at the first failure
+*/
+int taskMapPutMany(taskMap_t *map, const uint64_t *keys, void *const *values, size_t num) {
+	taskMapShard_t *locked = NULL;
+	int ret = 0;
+	size_t i;
+	for (i = 0; i < num && ret >= 0; ++i) {
+		uint64_t hash = mapHash(keys[i]);
+		taskMapShard_t *shard = mapShard(map, hash);
+		if (shard != locked) {
+			if (locked) {
+				unlockMutex(&(locked->lock));
+			}
+			lockMutex(&(shard->lock));
+			locked = shard;
+		}
+		ret = mapPutLocked(shard, hash, keys[i], values[i]);
+	}
+	if (locked) {
+		unlockMutex(&(locked->lock));
+	}
+	return ret < 0 ? -1 : 0;
+}
+
+//func runs inside one read section, updates done meanwhile may or may not be seen
+void taskMapForEach(taskMap_t *map, void (*func)(uint64_t key, void *value, void *arg), void *arg) {
+	unsigned int i;
+	size_t b;
+	rcuReadLock();
+	for (i = 0; i < (1U << map->shardBits); ++i) {
+		taskMapShard_t *shard = &(map->shards[i]);
+		for (b = 0; b <= shard->bucketMask; ++b) {
+			taskMapEntry_t *entry = rcuDereference(shard->buckets[b]);
+			while (entry) {
+				func(entry->key, rcuDereference(entry->value), arg);
+				entry = rcuDereference(entry->next);
+			}
+		}
+	}
+	rcuReadUnlock();
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* task creation and teardown from preemptible tasks at a short quantum:
+* ticks landing inside the allocator must not switch tasks there
+*/
+
+#include "taskLib.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Global variables */
+
+#define TEST_PARENTS 16
+#define TEST_CHILDREN 400
+
+//one counter per parent, a tick inside a shared increment would lose runs
+static unsigned long childRuns[TEST_PARENTS];
+
+/**********************************/
+/* Functions definitions */
+
+static void childFunc(int parent) {
+	++childRuns[parent];
+}
+
+static void parentFunc(int parent) {
+	int i;
+	for (i = 0; i < TEST_CHILDREN; ++i) {
+		taskNode_t *child = createTask();
+		CHECK(child != NULL);
+		initTask(child, (void (*)(void)) childFunc, 1, parent);
+		taskJoin(child);
+		CHECK(freeTask(child) == 0);
+	}
+}
+
+int main(void) {
+	taskNode_t *parents[TEST_PARENTS];
+	int i;
+	taskLibInit();
+	taskSetQuantum(50);
+	for (i = 0; i < TEST_PARENTS; ++i) {
+		parents[i] = createTask();
+		initTask(parents[i], (void (*)(void)) parentFunc, 1, i);
+	}
+	for (i = 0; i < TEST_PARENTS; ++i) {
+		taskJoin(parents[i]);
+		freeTask(parents[i]);
+		CHECK(childRuns[i] == TEST_CHILDREN);
+	}
+	return testDone("allocTest");
+}
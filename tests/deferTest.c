@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* deferred work: items queued from a timer callback run later in task
+* context in FIFO order, an item cannot be queued twice; items may block
+* beside a joining task, items keep running when tasks only sleep
+*/
+
+#include "taskLib.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Global variables */
+
+static taskWork_t works[3];
+static int order[4];
+static int orderLen;
+static int inCallback;
+static int ranInCallback;
+static taskTimer_t timer;
+static taskWork_t sleepWork;
+static int sleepRuns;
+static taskTimer_t periodic;
+static taskWork_t periodicWork;
+static int periodicRuns;
+
+/**********************************/
+/* Functions definitions */
+
+static void workFunc(void *arg) {
+	if (inCallback) {
+		++ranInCallback;
+	}
+	order[orderLen++] = (int) (long) arg;
+}
+
+static void timerFunc(void *arg) {
+	int i;
+	(void) arg;
+	inCallback = 1;
+	for (i = 0; i < 3; ++i) {
+		CHECK(taskDefer(&works[i], workFunc, (void*) (long) i) == 0);
+	}
+	CHECK(taskDefer(&works[0], workFunc, NULL) == -1);
+	inCallback = 0;
+}
+
+static void sleepFunc(void *arg) {
+	(void) arg;
+	taskSleep(1000000);
+	++sleepRuns;
+}
+
+static void childFunc(void) {
+	taskSleep(3000000);
+}
+
+static void periodicWorkFunc(void *arg) {
+	(void) arg;
+	++periodicRuns;
+}
+
+static void periodicFunc(void *arg) {
+	(void) arg;
+	taskDefer(&periodicWork, periodicWorkFunc, NULL);
+}
+
+static void sleeperFunc(void) {
+	int i;
+	for (i = 0; i < 20; ++i) {
+		taskSleep(500000);
+	}
+}
+
+int main(void) {
+	taskNode_t *child;
+	int i;
+	taskLibInit();
+	taskSimEnable();
+	taskTimerStart(&timer, taskTimeNs() + 1000000, 0, timerFunc, NULL);
+	taskSleep(2000000);
+	CHECK(orderLen == 3);
+	CHECK(ranInCallback == 0);
+	for (i = 0; i < orderLen; ++i) {
+		CHECK(order[i] == i);
+	}
+	//drained item can be queued again
+	CHECK(taskDefer(&works[0], workFunc, (void*) 3L) == 0);
+	schedule();
+	CHECK(orderLen == 4);
+
+	//sleeping item does not disturb the join wait
+	child = createTask();
+	initTask(child, childFunc, 0);
+	CHECK(taskDefer(&sleepWork, sleepFunc, NULL) == 0);
+	taskJoin(child);
+	CHECK(child->tState == ZOMBIE);
+	CHECK(sleepRuns == 1);
+	freeTask(child);
+
+	//only sleeps and a periodic timer, no task ever yields
+	taskTimerStart(&periodic, taskTimeNs() + 1000000, 1000000, periodicFunc, NULL);
+	child = createTask();
+	initTask(child, sleeperFunc, 0);
+	taskJoin(child);
+	taskTimerStop(&periodic);
+	CHECK(periodicRuns >= 9);
+	freeTask(child);
+	return testDone("deferTest");
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* delegation: closures from many clients run on the owner task only, each
+* once and in order of submission per client, results come back to callers
+*/
+
+#include <stdint.h>
+
+#include "taskLib.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Global variables */
+
+#define TEST_CLIENTS 6
+#define TEST_CALLS 5000
+
+static taskMailbox_t mailbox;
+static taskNode_t *owner;
+static int ownerStop;
+static unsigned long counter;
+static int wrongTask;
+static int lastSeen[TEST_CLIENTS];
+static int outOfOrder;
+static int badResults;
+
+/**********************************/
+/* Functions definitions */
+
+static void *countOp(void *arg) {
+	uintptr_t v = (uintptr_t) arg;
+	int client = v >> 16;
+	int seq = v & 0xffff;
+	if (taskSelf() != owner) {
+		++wrongTask;
+	}
+	if (seq != lastSeen[client] + 1) {
+		++outOfOrder;
+	}
+	lastSeen[client] = seq;
+	++counter;
+	return (void*) (v + 1);
+}
+
+static void ownerFunc(void) {
+	while (!ownerStop) {
+		delegateServe(&mailbox);
+	}
+}
+
+static void clientFunc(int id) {
+	int i;
+	for (i = 1; i <= TEST_CALLS; ++i) {
+		uintptr_t v = ((uintptr_t) id << 16) | i;
+		if (i % 2) {
+			if (delegateCall(&mailbox, countOp, (void*) v) != (void*) (v + 1)) {
+				++badResults;
+			}
+		}
+		else {
+			delegateReq_t req;
+			delegateSubmit(&mailbox, &req, countOp, (void*) v);
+			if (delegateWait(&req) != (void*) (v + 1)) {
+				++badResults;
+			}
+		}
+	}
+}
+
+static void *stopOp(void *arg) {
+	ownerStop = 1;
+	return arg;
+}
+
+int main(void) {
+	taskNode_t *clients[TEST_CLIENTS];
+	int i;
+	taskLibInit();
+	taskSetQuantum(200);
+	owner = createTask();
+	mailboxInit(&mailbox, owner);
+	initTask(owner, ownerFunc, 0);
+	for (i = 0; i < TEST_CLIENTS; ++i) {
+		clients[i] = createTask();
+		initTask(clients[i], (void (*)(void)) clientFunc, 1, i);
+	}
+	for (i = 0; i < TEST_CLIENTS; ++i) {
+		taskJoin(clients[i]);
+		freeTask(clients[i]);
+	}
+	delegateCall(&mailbox, stopOp, NULL);
+	taskJoin(owner);
+	freeTask(owner);
+	CHECK(counter == (unsigned long) TEST_CLIENTS * TEST_CALLS);
+	CHECK(wrongTask == 0);
+	CHECK(outOfOrder == 0);
+	CHECK(badResults == 0);
+	return testDone("delegateTest");
+}
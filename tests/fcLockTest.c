@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* flat-combining lock: every critical section runs exactly once and never
+* two at a time, with tasks preempted while holding or waiting for it
+*/
+
+#include "taskLib.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Global variables */
+
+#define TEST_TASKS 8
+#define TEST_OPS 100000
+
+static fcLock_t lock;
+static unsigned long counter;
+static int inside;
+static int overlaps;
+
+/**********************************/
+/* Functions definitions */
+
+static void incrementOp(void *arg) {
+	volatile int spin;
+	if (inside++) {
+		++overlaps;
+	}
+	for (spin = 0; spin < 50; ++spin) {
+	}
+	counter += (unsigned long) arg;
+	--inside;
+}
+
+static void workerFunc(void) {
+	int i;
+	for (i = 0; i < TEST_OPS; ++i) {
+		fcExecute(&lock, incrementOp, (void*) 1);
+	}
+}
+
+int main(void) {
+	taskNode_t *tasks[TEST_TASKS];
+	int i;
+	taskLibInit();
+	taskSetQuantum(100);
+	fcLockInit(&lock);
+	for (i = 0; i < TEST_TASKS; ++i) {
+		tasks[i] = createTask();
+		initTask(tasks[i], workerFunc, 0);
+	}
+	for (i = 0; i < TEST_TASKS; ++i) {
+		taskJoin(tasks[i]);
+		freeTask(tasks[i]);
+	}
+	CHECK(counter == (unsigned long) TEST_TASKS * TEST_OPS);
+	CHECK(overlaps == 0);
+	CHECK(lock.ops == (unsigned long) TEST_TASKS * TEST_OPS);
+	return testDone("fcLockTest");
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* sharded map: puts, lookups, removals and bulk operations agree with the
+* expected contents, also from tasks preempted at a short quantum while
+* entries are allocated and reclaimed
+*/
+
+#include <stdint.h>
+
+#include "taskLib.h"
+#include "taskMap.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Global variables */
+
+#define TEST_KEYS 1000
+#define TEST_WORKERS 8
+#define TEST_ROUNDS 20000
+#define TEST_WORKER_KEYS 64
+
+static taskMap_t map;
+static uint64_t sum;
+static unsigned long badValues[TEST_WORKERS];
+
+/**********************************/
+/* Functions definitions */
+
+static void sumFunc(uint64_t key, void *value, void *arg) {
+	(void) arg;
+	CHECK((uintptr_t) value == key * 2);
+	sum += key;
+}
+
+//each worker churns its own keys, entries are freed by RCU callbacks
+static void workerFunc(int id) {
+	int i;
+	for (i = 0; i < TEST_ROUNDS; ++i) {
+		uint64_t key = (uint64_t) id * TEST_WORKER_KEYS + i % TEST_WORKER_KEYS;
+		if (taskMapPut(&map, key, (void*) (uintptr_t) (key + 1)) != 1) {
+			++badValues[id];
+		}
+		if (taskMapGet(&map, key) != (void*) (uintptr_t) (key + 1)) {
+			++badValues[id];
+		}
+		if (taskMapRemove(&map, key) != (void*) (uintptr_t) (key + 1)) {
+			++badValues[id];
+		}
+		if (i % 16 == 0) {
+			schedule();
+		}
+	}
+}
+
+int main(void) {
+	taskNode_t *workers[TEST_WORKERS];
+	int i;
+	uint64_t keys[4] = {1, 2, TEST_KEYS + 1, 3};
+	void *values[4];
+	uint64_t k;
+	taskLibInit();
+	CHECK(taskMapInit(&map, TASK_MAP_SHARDS_DEFAULT, 64) == 0);
+	for (k = 1; k <= TEST_KEYS; ++k) {
+		CHECK(taskMapPut(&map, k, (void*) (uintptr_t) (k * 2)) == 1);
+	}
+	CHECK(taskMapCount(&map) == TEST_KEYS);
+	CHECK(taskMapGet(&map, 7) == (void*) 14);
+	CHECK(taskMapGet(&map, TEST_KEYS + 1) == NULL);
+	CHECK(taskMapRemove(&map, 7) == (void*) 14);
+	CHECK(taskMapGet(&map, 7) == NULL);
+	CHECK(taskMapCount(&map) == TEST_KEYS - 1);
+	CHECK(taskMapGetMany(&map, keys, values, 4) == 3);
+	CHECK(values[0] == (void*) 2 && values[2] == NULL && values[3] == (void*) 6);
+	taskMapForEach(&map, sumFunc, NULL);
+	CHECK(sum == (uint64_t) TEST_KEYS * (TEST_KEYS + 1) / 2 - 7);
+	taskMapDestroy(&map);
+
+	CHECK(taskMapInit(&map, TASK_MAP_SHARDS_DEFAULT, TEST_WORKERS * TEST_WORKER_KEYS) == 0);
+	taskSetQuantum(50);
+	for (i = 0; i < TEST_WORKERS; ++i) {
+		workers[i] = createTask();
+		initTask(workers[i], (void (*)(void)) workerFunc, 1, i);
+	}
+	for (i = 0; i < TEST_WORKERS; ++i) {
+		taskJoin(workers[i]);
+		freeTask(workers[i]);
+		CHECK(badValues[i] == 0);
+	}
+	CHECK(taskMapCount(&map) == 0);
+	//let pending RCU callbacks run before the map goes away
+	synchronizeRcu();
+	schedule();
+	taskMapDestroy(&map);
+	return testDone("mapTest");
+}
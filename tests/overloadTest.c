@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* overload control in virtual time: queued spawns waiting longer than the
+* shed deadline are dropped without running, their joiners still return;
+* spawns pushed to the queue head under overload keep the rest queued;
+* LIFO service under overload does not starve an old ready task for good
+*/
+
+#include "taskLib.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Global variables */
+
+#define TEST_SPAWNS 12
+#define TEST_WORKERS 3
+#define TEST_WAKERS 3
+
+static int ran;
+static taskNode_t *tasks[TEST_SPAWNS];
+static int pushed;
+static int stop;
+static unsigned long cpuIters;
+
+/**********************************/
+/* Functions definitions */
+
+static void workFunc(void *arg) {
+	int i;
+	(void) arg;
+	for (i = 0; i < 20; ++i) {
+		taskSimWork(1000000);
+	}
+	++ran;
+}
+
+//workers delay each other, the first one spawns B and C once that is overload
+static void longWorkFunc(void *arg) {
+	int i;
+	for (i = 0; i < 100; ++i) {
+		taskSimWork(1000000);
+		if (arg && taskOverloaded() && !pushed) {
+			pushed = 1;
+			CHECK(taskSpawn(tasks[TEST_WORKERS + 1], workFunc, NULL) == 1);
+			taskOverloadControl(0, 0, 0);
+			CHECK(taskSpawn(tasks[TEST_WORKERS + 2], workFunc, NULL) == 1);
+		}
+	}
+	++ran;
+}
+
+//woken often, so under LIFO these always come before the CPU bound task
+static void wakerFunc(void *arg) {
+	(void) arg;
+	while (!stop) {
+		taskSleep(1000000);
+		taskSimWork(1000000);
+	}
+}
+
+static void cpuFunc(void *arg) {
+	(void) arg;
+	while (!stop) {
+		taskSimWork(100000);
+		++cpuIters;
+	}
+}
+
+int main(void) {
+	taskMetrics_t m;
+	int never = 0;
+	int lost = 0;
+	unsigned long cpuBefore;
+	int i;
+	taskLibInit();
+	taskSimEnable();
+	taskSetQuantum(2000);
+	//spawner runs first, so all spawns are queued at once
+	taskSetPriority(taskSelf(), 1);
+	taskSpawnLimit(0, 3, SPAWN_QUEUE);
+	taskOverloadControl(1000000, 1000000, 30000000);
+	for (i = 0; i < TEST_SPAWNS; ++i) {
+		tasks[i] = createTask();
+		CHECK(taskSpawn(tasks[i], workFunc, NULL) == (i < 3 ? 0 : 1));
+	}
+	for (i = 0; i < TEST_SPAWNS; ++i) {
+		taskJoin(tasks[i]);
+		if (!tasks[i]->runs) {
+			++never;
+		}
+		CHECK(freeTask(tasks[i]) == 0);
+	}
+	taskGetMetrics(&m);
+	CHECK(ran == 3);
+	CHECK(never == TEST_SPAWNS - 3);
+	CHECK(m.shed == TEST_SPAWNS - 3);
+
+	//without overload control queued spawns all run
+	taskOverloadControl(0, 0, 0);
+	ran = 0;
+	for (i = 0; i < TEST_SPAWNS; ++i) {
+		tasks[i] = createTask();
+		taskSpawn(tasks[i], workFunc, NULL);
+	}
+	for (i = 0; i < TEST_SPAWNS; ++i) {
+		taskJoin(tasks[i]);
+		freeTask(tasks[i]);
+	}
+	CHECK(ran == TEST_SPAWNS);
+
+	//A queued, B pushed before it under overload, C queued after it
+	taskSpawnLimit(0, TEST_WORKERS, SPAWN_QUEUE);
+	taskOverloadControl(1000000, 1000000, 0);
+	ran = 0;
+	for (i = 0; i < TEST_WORKERS + 3; ++i) {
+		tasks[i] = createTask();
+	}
+	for (i = 0; i < TEST_WORKERS; ++i) {
+		CHECK(taskSpawn(tasks[i], longWorkFunc, (void*) (long) (i == 0)) == 0);
+	}
+	CHECK(taskSpawn(tasks[TEST_WORKERS], workFunc, NULL) == 1);
+	for (i = 0; i < TEST_WORKERS; ++i) {
+		taskJoin(tasks[i]);
+	}
+	//A is queued before C, it must have started once C ended
+	for (i = TEST_WORKERS + 2; i >= 0; --i) {
+		if (i == TEST_WORKERS && tasks[i]->spawnQueued) {
+			++lost;
+			continue;
+		}
+		taskJoin(tasks[i]);
+		CHECK(freeTask(tasks[i]) == 0);
+	}
+	CHECK(lost == 0);
+	CHECK(ran == TEST_WORKERS + 3);
+
+	//wakers keep the queue busy, overload still clears and lets the old task run
+	taskSpawnLimit(0, 0, SPAWN_QUEUE);
+	taskOverloadControl(1000000, 5000000, 0);
+	for (i = 0; i <= TEST_WAKERS; ++i) {
+		tasks[i] = createTask();
+		CHECK(taskSpawn(tasks[i], i ? wakerFunc : cpuFunc, NULL) == 0);
+	}
+	taskSleep(100000000);
+	cpuBefore = cpuIters;
+	taskSleep(100000000);
+	CHECK(cpuIters > cpuBefore);
+	stop = 1;
+	for (i = 0; i <= TEST_WAKERS; ++i) {
+		taskJoin(tasks[i]);
+		CHECK(freeTask(tasks[i]) == 0);
+	}
+	return testDone("overloadTest");
+}
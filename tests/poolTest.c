@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* resource pool: never more items out than the pool has, waiters are served
+* in FIFO order, acquire gives up after its timeout
+*/
+
+#include "taskLib.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Global variables */
+
+#define TEST_ITEMS 2
+#define TEST_WAITERS 4
+
+static int itemData[TEST_ITEMS];
+static taskPool_t pool;
+static int held;
+static int maxHeld;
+static int order[TEST_WAITERS];
+static int orderLen;
+
+/**********************************/
+/* Functions definitions */
+
+static void holderFunc(void) {
+	void *item = taskPoolAcquire(&pool, TASK_POOL_FOREVER);
+	CHECK(item != NULL);
+	++held;
+	taskSleep(2000000);
+	--held;
+	taskPoolRelease(&pool, item);
+}
+
+static void waiterFunc(int id) {
+	void *item = taskPoolAcquire(&pool, TASK_POOL_FOREVER);
+	CHECK(item != NULL);
+	order[orderLen++] = id;
+	if (++held > maxHeld) {
+		maxHeld = held;
+	}
+	taskSleep(1000000);
+	--held;
+	taskPoolRelease(&pool, item);
+}
+
+int main(void) {
+	void *items[TEST_ITEMS];
+	taskNode_t *holders[TEST_ITEMS];
+	taskNode_t *waiters[TEST_WAITERS];
+	uint64_t t0;
+	int i;
+	taskLibInit();
+	for (i = 0; i < TEST_ITEMS; ++i) {
+		items[i] = &itemData[i];
+	}
+	CHECK(taskPoolInit(&pool, items, TEST_ITEMS) == 0);
+	for (i = 0; i < TEST_ITEMS; ++i) {
+		holders[i] = createTask();
+		initTask(holders[i], holderFunc, 0);
+	}
+	CHECK(taskPoolAcquire(&pool, 0) == NULL);
+	//waiters queue up in the order they start
+	for (i = 0; i < TEST_WAITERS; ++i) {
+		waiters[i] = createTask();
+		initTask(waiters[i], (void (*)(void)) waiterFunc, 1, i);
+	}
+	t0 = taskTimeNs();
+	CHECK(taskPoolAcquire(&pool, 500000) == NULL);
+	CHECK(taskTimeNs() - t0 >= 500000);
+	for (i = 0; i < TEST_ITEMS; ++i) {
+		taskJoin(holders[i]);
+		freeTask(holders[i]);
+	}
+	for (i = 0; i < TEST_WAITERS; ++i) {
+		taskJoin(waiters[i]);
+		freeTask(waiters[i]);
+	}
+	CHECK(orderLen == TEST_WAITERS);
+	for (i = 0; i < orderLen; ++i) {
+		CHECK(order[i] == i);
+	}
+	CHECK(maxHeld <= TEST_ITEMS);
+	CHECK(pool.freeNum == TEST_ITEMS);
+	CHECK(pool.timeouts == 1);
+	taskPoolDestroy(&pool);
+	return testDone("poolTest");
+}
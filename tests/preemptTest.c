@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* preemption mixed with voluntary switches: tasks keep state in registers
+* while ticks at a short quantum and schedule() calls interleave; every
+* task must end with the result computed without tasks
+*/
+
+#include <stdint.h>
+
+#include "taskLib.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Global variables */
+
+#define TEST_TASKS 4
+#define TEST_ITERS 40000000UL
+
+static uint64_t results[TEST_TASKS];
+static int finished;
+
+/**********************************/
+/* Functions definitions */
+
+static uint64_t mixLoop(int yield) {
+	uint64_t a = 1, b = 2, c = 3, d = 4;
+	unsigned long i;
+	for (i = 0; i < TEST_ITERS; ++i) {
+		a += i;
+		b ^= a;
+		c += b >> 3;
+		d += c ^ i;
+		if (yield && (i & 0xfff) == 0) {
+			schedule();
+		}
+	}
+	return a ^ b ^ c ^ d;
+}
+
+static void mixFunc(int id) {
+	results[id] = mixLoop(1);
+	++finished;
+}
+
+int main(void) {
+	taskNode_t *tasks[TEST_TASKS];
+	uint64_t expected;
+	int i;
+	taskLibInit();
+	expected = mixLoop(0);
+	taskSetQuantum(100);
+	for (i = 0; i < TEST_TASKS; ++i) {
+		tasks[i] = createTask();
+		initTask(tasks[i], (void (*)(void)) mixFunc, 1, i);
+	}
+	for (i = 0; i < TEST_TASKS; ++i) {
+		taskJoin(tasks[i]);
+		freeTask(tasks[i]);
+		CHECK(results[i] == expected);
+	}
+	CHECK(finished == TEST_TASKS);
+	return testDone("preemptTest");
+}
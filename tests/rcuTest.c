@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* RCU: readers preempted inside read sections never see an object which
+* the writer already reclaimed, callRcu callbacks run once after a grace
+* period
+*/
+
+#include "taskLib.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Global variables */
+
+#define TEST_READERS 4
+#define TEST_READS 2000000
+#define TEST_UPDATES 20000
+
+typedef struct __testObj_t {
+	int valid;
+	int value;
+} testObj_t;
+
+static testObj_t objs[2];
+static testObj_t *current;
+static int badReads;
+static int readersDone;
+static int cbRuns;
+static rcuHead_t cbHead;
+
+/**********************************/
+/* Functions definitions */
+
+static void readerFunc(void) {
+	int i;
+	for (i = 0; i < TEST_READS; ++i) {
+		testObj_t *obj;
+		rcuReadLock();
+		obj = rcuDereference(current);
+		if (!obj->valid || obj->value < 0) {
+			++badReads;
+		}
+		rcuReadUnlock();
+	}
+	++readersDone;
+}
+
+static void writerFunc(void) {
+	int i;
+	for (i = 1; i <= TEST_UPDATES; ++i) {
+		testObj_t *old = current;
+		testObj_t *obj = (old == &objs[0]) ? &objs[1] : &objs[0];
+		obj->value = i;
+		obj->valid = 1;
+		rcuAssignPointer(current, obj);
+		synchronizeRcu();
+		//no reader can hold it now, poison it
+		old->valid = 0;
+		old->value = -1;
+	}
+}
+
+static void cbFunc(rcuHead_t *head) {
+	CHECK(head == &cbHead);
+	++cbRuns;
+}
+
+int main(void) {
+	taskNode_t *readers[TEST_READERS];
+	taskNode_t *writer;
+	int i;
+	taskLibInit();
+	taskSetQuantum(200);
+	objs[0].valid = 1;
+	current = &objs[0];
+	for (i = 0; i < TEST_READERS; ++i) {
+		readers[i] = createTask();
+		initTask(readers[i], readerFunc, 0);
+	}
+	writer = createTask();
+	initTask(writer, writerFunc, 0);
+	taskJoin(writer);
+	for (i = 0; i < TEST_READERS; ++i) {
+		taskJoin(readers[i]);
+		freeTask(readers[i]);
+	}
+	freeTask(writer);
+	CHECK(badReads == 0);
+	CHECK(readersDone == TEST_READERS);
+
+	callRcu(&cbHead, cbFunc);
+	synchronizeRcu();
+	for (i = 0; i < 4 && !cbRuns; ++i) {
+		schedule();
+	}
+	CHECK(cbRuns == 1);
+	return testDone("rcuTest");
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* seqlock: preempted writers never let readers return a torn copy
+*/
+
+#include <stdint.h>
+
+#include "taskLib.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Global variables */
+
+#define TEST_READERS 3
+#define TEST_WRITERS 2
+#define TEST_OPS 2000000
+
+static taskSeqlock_t lock;
+static volatile uint64_t first;
+static volatile uint64_t second;
+static int torn;
+static uint64_t reads;
+
+/**********************************/
+/* Functions definitions */
+
+static void writerFunc(int id) {
+	uint64_t i;
+	for (i = 0; i < TEST_OPS; ++i) {
+		uint64_t v = (i << 8) | id;
+		seqlockWriteBegin(&lock);
+		first = v;
+		second = ~v;
+		seqlockWriteEnd(&lock);
+	}
+}
+
+static void readerFunc(void) {
+	int i;
+	for (i = 0; i < TEST_OPS; ++i) {
+		uint64_t a, b;
+		unsigned int seq;
+		do {
+			seq = seqlockReadBegin(&lock);
+			a = first;
+			b = second;
+		} while (seqlockReadRetry(&lock, seq));
+		if (a != ~b) {
+			++torn;
+		}
+		++reads;
+	}
+}
+
+int main(void) {
+	taskNode_t *tasks[TEST_READERS + TEST_WRITERS];
+	int i;
+	taskLibInit();
+	taskSetQuantum(100);
+	seqlockInit(&lock);
+	second = ~first;
+	for (i = 0; i < TEST_WRITERS; ++i) {
+		tasks[i] = createTask();
+		initTask(tasks[i], (void (*)(void)) writerFunc, 1, i);
+	}
+	for (; i < TEST_READERS + TEST_WRITERS; ++i) {
+		tasks[i] = createTask();
+		initTask(tasks[i], readerFunc, 0);
+	}
+	for (i = 0; i < TEST_READERS + TEST_WRITERS; ++i) {
+		taskJoin(tasks[i]);
+		freeTask(tasks[i]);
+	}
+	CHECK(torn == 0);
+	CHECK(reads == (uint64_t) TEST_READERS * TEST_OPS);
+	CHECK(first == ~second);
+	CHECK(!(lock.seq & 1));
+	return testDone("seqlockTest");
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* spawn admission control: live tasks stay within global and group limits
+* when spawns fail, block or queue; queued tasks start once capacity frees
+*/
+
+#include <errno.h>
+
+#include "taskLib.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Global variables */
+
+#define TEST_SPAWNS 20
+
+static int live;
+static int maxLive;
+static int done;
+
+/**********************************/
+/* Functions definitions */
+
+static void workFunc(void *arg) {
+	int i;
+	(void) arg;
+	if (++live > maxLive) {
+		maxLive = live;
+	}
+	for (i = 0; i < 5; ++i) {
+		schedule();
+	}
+	--live;
+	++done;
+}
+
+static void resetCounters(void) {
+	live = 0;
+	maxLive = 0;
+	done = 0;
+}
+
+static void joinAll(taskNode_t **tasks, int num) {
+	int i;
+	for (i = 0; i < num; ++i) {
+		taskJoin(tasks[i]);
+		CHECK(freeTask(tasks[i]) == 0);
+	}
+}
+
+int main(void) {
+	taskNode_t *tasks[TEST_SPAWNS];
+	int queued = 0;
+	int refused = 0;
+	int ret;
+	int i;
+	taskLibInit();
+
+	//queued spawns wait without a stack
+	taskSpawnLimit(0, 3, SPAWN_QUEUE);
+	for (i = 0; i < TEST_SPAWNS; ++i) {
+		tasks[i] = createTask();
+		ret = taskSpawn(tasks[i], workFunc, NULL);
+		CHECK(ret >= 0);
+		if (ret == 1) {
+			++queued;
+			CHECK(tasks[i]->context.uc_stack.ss_sp == NULL);
+			CHECK(freeTask(tasks[i]) == -1);
+		}
+	}
+	joinAll(tasks, TEST_SPAWNS);
+	CHECK(queued > 0);
+	CHECK(done == TEST_SPAWNS);
+	CHECK(maxLive == 3);
+
+	resetCounters();
+	taskSpawnLimit(0, 2, SPAWN_FAIL);
+	for (i = 0; i < 5; ++i) {
+		tasks[i] = createTask();
+		errno = 0;
+		if (taskSpawn(tasks[i], workFunc, NULL) < 0) {
+			CHECK(errno == EAGAIN);
+			++refused;
+			CHECK(freeTask(tasks[i]) == 0);
+			tasks[i] = NULL;
+		}
+	}
+	CHECK(refused == 3);
+	for (i = 0; i < 5; ++i) {
+		if (tasks[i]) {
+			taskJoin(tasks[i]);
+			freeTask(tasks[i]);
+		}
+	}
+	CHECK(maxLive == 2);
+
+	resetCounters();
+	taskSpawnLimit(0, 2, SPAWN_BLOCK);
+	for (i = 0; i < 6; ++i) {
+		tasks[i] = createTask();
+		CHECK(taskSpawn(tasks[i], workFunc, NULL) == 0);
+	}
+	joinAll(tasks, 6);
+	CHECK(maxLive == 2);
+
+	//group limit is tighter than the global one
+	resetCounters();
+	taskSpawnLimit(0, 8, SPAWN_BLOCK);
+	taskSpawnLimit(7, 1, SPAWN_QUEUE);
+	for (i = 0; i < 6; ++i) {
+		tasks[i] = createTask();
+		taskSetGroup(tasks[i], 7);
+		CHECK(taskSpawn(tasks[i], workFunc, NULL) >= 0);
+	}
+	joinAll(tasks, 6);
+	CHECK(done == 6);
+	CHECK(maxLive == 1);
+	return testDone("spawnTest");
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* timers in virtual time: one-shot and periodic callbacks fire at their
+* release times, periodic ones without drift, stopped ones no more; timers
+* started from a callback do not grow the heap, from a task they do
+*/
+
+#include "taskLib.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Global variables */
+
+static taskTimer_t oneShot;
+static taskTimer_t periodic;
+static uint64_t oneShotAt;
+static uint64_t lastAt;
+static int oneShotRuns;
+static int periodicRuns;
+static int lateRuns;
+static uint64_t start;
+static taskTimer_t nested[128];
+static int nestedStarted;
+static int nestedFailed;
+static int nestedRuns;
+
+/**********************************/
+/* Functions definitions */
+
+static void oneShotFunc(void *arg) {
+	(void) arg;
+	++oneShotRuns;
+	oneShotAt = taskTimeNs();
+}
+
+static void periodicFunc(void *arg) {
+	uint64_t now = taskTimeNs();
+	(void) arg;
+	++periodicRuns;
+	//releases stay on the grid of the first expiry
+	if (now != start + periodicRuns * 10000000ULL) {
+		++lateRuns;
+	}
+	lastAt = now;
+}
+
+static void nestedFunc(void *arg) {
+	(void) arg;
+	++nestedRuns;
+}
+
+static void starterFunc(void *arg) {
+	int i;
+	(void) arg;
+	for (i = 0; i < 128; ++i) {
+		if (taskTimerStart(&nested[i], taskTimeNs() + 1000000, 0, nestedFunc, NULL) == 0) {
+			++nestedStarted;
+		}
+		else {
+			++nestedFailed;
+		}
+	}
+}
+
+int main(void) {
+	int i;
+	int runs;
+	taskLibInit();
+	taskSimEnable();
+	start = taskTimeNs();
+	CHECK(taskTimerStart(&oneShot, start + 5000000, 0, oneShotFunc, NULL) == 0);
+	CHECK(taskTimerStart(&periodic, start + 10000000, 10000000, periodicFunc, NULL) == 0);
+	taskSleep(105000000);
+	CHECK(oneShotRuns == 1);
+	CHECK(oneShotAt == start + 5000000);
+	CHECK(periodicRuns == 10);
+	CHECK(lateRuns == 0);
+	taskTimerStop(&periodic);
+	runs = periodicRuns;
+	taskSleep(50000000);
+	CHECK(periodicRuns == runs);
+
+	CHECK(taskTimerStart(&oneShot, taskTimeNs() + 1000000, 0, starterFunc, NULL) == 0);
+	taskSleep(5000000);
+	CHECK(nestedFailed > 0);
+	CHECK(nestedRuns == nestedStarted);
+	for (i = 0; i < 128; ++i) {
+		CHECK(taskTimerStart(&nested[i], taskTimeNs() + 1000000, 0, nestedFunc, NULL) == 0);
+	}
+	taskSleep(5000000);
+	CHECK(nestedRuns == nestedStarted + 128);
+	return testDone("timerTest");
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* timers in real time: a periodic callback keeps its period beside a CPU
+* bound task, without waiting for the quantum to end
+*/
+
+#include "taskLib.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Global variables */
+
+#define TEST_PERIOD_NS 10000000ULL
+#define TEST_SPIN_NS 500000000ULL
+
+static taskTimer_t periodic;
+static int periodicRuns;
+static uint64_t lastAt;
+static uint64_t maxGap;
+
+/**********************************/
+/* Functions definitions */
+
+static void periodicFunc(void *arg) {
+	uint64_t now = taskTimeNs();
+	(void) arg;
+	if (periodicRuns++ && now - lastAt > maxGap) {
+		maxGap = now - lastAt;
+	}
+	lastAt = now;
+}
+
+static void spinFunc(void) {
+	uint64_t end = taskTimeNs() + TEST_SPIN_NS;
+	while (taskTimeNs() < end) {
+	}
+}
+
+int main(void) {
+	taskNode_t *spin;
+	taskLibInit();
+	CHECK(taskTimerStart(&periodic, taskTimeNs() + TEST_PERIOD_NS, TEST_PERIOD_NS, periodicFunc, NULL) == 0);
+	//spinning task runs alone well within the default quantum
+	spin = createTask();
+	initTask(spin, spinFunc, 0);
+	taskJoin(spin);
+	taskTimerStop(&periodic);
+	freeTask(spin);
+	CHECK(periodicRuns >= (int) (TEST_SPIN_NS / TEST_PERIOD_NS) * 8 / 10);
+	CHECK(maxGap < 3 * TEST_PERIOD_NS);
+	return testDone("timerTickTest");
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2012, Janusz Lisiecki
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL JANUSZ LISIECKI OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+* token bucket in virtual time: burst is available at once, then tokens come
+* at the configured rate, waits over the limit are refused without reserving
+*/
+
+#include "taskLib.h"
+
+#include "testUtil.h"
+
+/**********************************/
+/* Functions definitions */
+
+int main(void) {
+	tokenBucket_t bucket;
+	uint64_t t0;
+	int i;
+	taskLibInit();
+	taskSimEnable();
+	//1000 tokens per second, 1 ms each
+	tokenBucketInit(&bucket, 1000, 10);
+	for (i = 0; i < 10; ++i) {
+		CHECK(tokenBucketTryAcquire(&bucket, 1) == 0);
+	}
+	CHECK(tokenBucketTryAcquire(&bucket, 1) == -1);
+	CHECK(tokenBucketAcquire(&bucket, 5, 1000000) == TOKEN_NO_WAIT);
+
+	t0 = taskTimeNs();
+	for (i = 0; i < 100; ++i) {
+		tokenBucketAcquire(&bucket, 1, TOKEN_NO_WAIT);
+	}
+	//100 tokens at 1 ms each, first one after the burst
+	CHECK(taskTimeNs() - t0 >= 99000000);
+	CHECK(taskTimeNs() - t0 <= 101000000);
+
+	taskSleep(20000000);
+	for (i = 0; i < 10; ++i) {
+		CHECK(tokenBucketTryAcquire(&bucket, 1) == 0);
+	}
+	CHECK(tokenBucketTryAcquire(&bucket, 1) == -1);
+	return testDone("tokenBucketTest");
+}